@@ -0,0 +1,442 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+using namespace std;
+
+// Shape of the join graph of a generated workload
+enum Shape { SHAPE_CHAIN, SHAPE_STAR, SHAPE_SNOWFLAKE, SHAPE_CLIQUE };
+
+// How the reduction factors of non-key columns are drawn
+enum RFDistribution { RF_UNIFORM, RF_SKEWED, RF_FIXED };
+
+// For storing the settings of one generated workload
+struct WorkloadSpec {
+    Shape shape = SHAPE_CHAIN;
+    int ntables = 4;
+    // Fraction of join and key columns that get an index
+    double indexDensity = 0.5;
+    RFDistribution rfDist = RF_UNIFORM;
+    // Fraction of tables that get a selection before they are joined
+    double selectionDensity = 0.3;
+    unsigned int seed = 1;
+};
+
+// For storing a generated table before it is written out
+struct GenTable {
+    string name;
+    vector<string> columns;
+    int ntuples = 0;
+    int npages = 0;
+};
+
+// For storing one join predicate of a generated query
+struct GenJoin {
+    int parent;
+    int child;
+    string parentCol;
+    string childCol;
+};
+
+const char* shapeNames[] = {"chain", "star", "snowflake", "clique"};
+const char* rfNames[] = {"uniform", "skewed", "fixed"};
+
+// Parses a shape name
+Shape parseShape(const string& name) {
+    for (int i = 0; i < 4; i++) {
+        if (name == shapeNames[i]) {
+            return (Shape)i;
+        }
+    }
+    throw invalid_argument("unknown shape " + name);
+}
+
+// Parses an RF distribution name
+RFDistribution parseRFDistribution(const string& name) {
+    for (int i = 0; i < 3; i++) {
+        if (name == rfNames[i]) {
+            return (RFDistribution)i;
+        }
+    }
+    throw invalid_argument("unknown RF distribution " + name);
+}
+
+// Splits a comma separated option value
+vector<string> splitList(const string& list) {
+    vector<string> items;
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (item != "") {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+// Picks the table each table joins to, which decides the shape of the join graph
+// Table 0 is the root (the fact table for star and snowflake)
+vector<int> joinParents(const WorkloadSpec& spec, mt19937& rng) {
+    vector<int> parents(spec.ntables, -1);
+    int ndims = max(1, (int)sqrt((double)spec.ntables));
+    for (int i = 1; i < spec.ntables; i++) {
+        switch (spec.shape) {
+            case SHAPE_CHAIN:
+                parents[i] = i - 1;
+                break;
+            case SHAPE_STAR:
+                parents[i] = 0;
+                break;
+            case SHAPE_SNOWFLAKE:
+                // The first dimensions hang off the fact table, the rest off those dimensions
+                parents[i] = (i <= ndims) ? 0 : 1 + (i - ndims - 1) % ndims;
+                break;
+            case SHAPE_CLIQUE:
+                parents[i] = uniform_int_distribution<int>(0, i - 1)(rng);
+                break;
+        }
+    }
+    return parents;
+}
+
+// Draws the reduction factor of a non-key column
+double drawRF(RFDistribution dist, mt19937& rng) {
+    uniform_real_distribution<double> unit(0.0, 1.0);
+    switch (dist) {
+        case RF_UNIFORM:
+            return 0.001 + unit(rng) * 0.499;
+        case RF_SKEWED:
+            // Most columns are very selective and a few are not selective at all
+            return 0.001 + pow(unit(rng), 4) * 0.899;
+        default:
+            return 0.1;
+    }
+}
+
+// Writes the statistics of an index on a column
+void writeIndex(ostream& out, const GenTable& tbl, const string& col, int nkeys, mt19937& rng) {
+    out << "Cardinality(" << col << " in " << tbl.name << ") = " << nkeys << endl;
+    out << "SIZE(" << col << " in " << tbl.name << ") = " << max(1, tbl.npages / 10) << endl;
+    out << "Height(" << col << " in " << tbl.name << ") = " << uniform_int_distribution<int>(1, 3)(rng) << endl;
+    out << "Range(" << col << " in " << tbl.name << ") = 1," << max(2, nkeys) << endl;
+}
+
+// Writes a catalog and a query of the requested shape in the input format of QueryOptimizer
+void generateWorkload(const WorkloadSpec& spec, ostream& out) {
+    mt19937 rng(spec.seed);
+    uniform_real_distribution<double> unit(0.0, 1.0);
+    vector<int> parents = joinParents(spec, rng);
+
+    // Every table has a key and a selection attribute, plus the columns its joins need
+    vector<GenTable> tables(spec.ntables);
+    vector<GenJoin> joins;
+    for (int i = 0; i < spec.ntables; i++) {
+        tables[i].name = "T" + to_string(i);
+        tables[i].columns.push_back("K" + to_string(i));
+        tables[i].columns.push_back("A" + to_string(i));
+        // Table sizes are log-uniform between 1k and 1M tuples, with the root the largest
+        double logSize = (i == 0 && spec.shape != SHAPE_CHAIN) ? 6 : 3 + unit(rng) * 3;
+        tables[i].ntuples = (int)pow(10, logSize);
+        tables[i].npages = max(1, tables[i].ntuples / uniform_int_distribution<int>(10, 100)(rng));
+    }
+    for (int i = 1; i < spec.ntables; i++) {
+        GenJoin join;
+        join.parent = parents[i];
+        join.child = i;
+        join.parentCol = "F" + to_string(parents[i]) + "_" + to_string(i);
+        join.childCol = "K" + to_string(i);
+        tables[join.parent].columns.push_back(join.parentCol);
+        joins.push_back(join);
+    }
+    if (spec.shape == SHAPE_CLIQUE) {
+        // Every pair of tables is joinable, though each query only uses a spanning tree of the pairs
+        for (int i = 0; i < spec.ntables; i++) {
+            for (int j = 0; j < spec.ntables; j++) {
+                string col = "F" + to_string(i) + "_" + to_string(j);
+                if (i != j && parents[j] != i) {
+                    tables[i].columns.push_back(col);
+                }
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < tables.size(); i++) {
+        out << "TABLE " << tables[i].name << "(";
+        for (unsigned int j = 0; j < tables[i].columns.size(); j++) {
+            out << tables[i].columns[j] << ",";
+        }
+        out << "PRIMARY KEY(K" << i << "));" << endl;
+    }
+    for (unsigned int i = 0; i < joins.size(); i++) {
+        out << "FOREIGN KEY (" << tables[joins[i].parent].name << "(" << joins[i].parentCol << ") REFERENCES "
+            << tables[joins[i].child].name << "(" << joins[i].childCol << "));" << endl;
+    }
+    for (unsigned int i = 0; i < tables.size(); i++) {
+        GenTable& tbl = tables[i];
+        out << "Cardinality(" << tbl.name << ") = " << tbl.ntuples << endl;
+        out << "SIZE(" << tbl.name << ") = " << tbl.npages << endl;
+        if (unit(rng) < spec.indexDensity) {
+            writeIndex(out, tbl, tbl.columns[0], tbl.ntuples, rng);
+        }
+        out << "RF(" << tbl.columns[0] << " in " << tbl.name << ") = " << 1.0 / tbl.ntuples << endl;
+        for (unsigned int j = 1; j < tbl.columns.size(); j++) {
+            out << "RF(" << tbl.columns[j] << " in " << tbl.name << ") = " << drawRF(spec.rfDist, rng) << endl;
+        }
+    }
+    for (unsigned int i = 0; i < joins.size(); i++) {
+        if (unit(rng) < spec.indexDensity) {
+            GenTable& tbl = tables[joins[i].parent];
+            writeIndex(out, tbl, joins[i].parentCol, min(tbl.ntuples, tables[joins[i].child].ntuples), rng);
+        }
+    }
+
+    // Selections first, then the joins in table order as a left-deep tree, then the projection
+    int nextOp = 1;
+    vector<string> inputs(spec.ntables);
+    for (int i = 0; i < spec.ntables; i++) {
+        inputs[i] = tables[i].name;
+        if (unit(rng) < spec.selectionDensity) {
+            string opName = "OP" + to_string(nextOp++);
+            out << opName << " = " << tables[i].name << " SELECTION A" << i
+                << (unit(rng) < 0.5 ? "=" : ">") << uniform_int_distribution<int>(1, 100)(rng) << endl;
+            inputs[i] = opName;
+        }
+    }
+    string current = inputs[0];
+    for (unsigned int i = 0; i < joins.size(); i++) {
+        string opName = "OP" + to_string(nextOp++);
+        out << opName << " = " << current << " JOIN " << inputs[joins[i].child] << " ON "
+            << joins[i].parentCol << "=" << joins[i].childCol << endl;
+        current = opName;
+    }
+    out << "RESULT = " << current << " PROJECTION A0,K" << spec.ntables - 1 << endl;
+}
+
+// For storing what one optimizer run reported
+struct RunResult {
+    bool ok = false;
+    double wallMs = 0;
+    double parseMs = 0;
+    double costingMs = 0;
+    double treeMs = 0;
+    double enumerationMs = 0;
+    long peakKb = 0;
+    long plans = 0;
+    long regularCost = 0;
+    long optimizedCost = 0;
+};
+
+// Reads a whole file into a string
+string readFile(const string& fileName) {
+    ifstream in(fileName);
+    stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+// Extracts the number that follows a key in the --stats-json output
+double jsonNumber(const string& json, const string& key) {
+    size_t pos = json.find("\"" + key + "\": ");
+    if (pos == string::npos) {
+        return 0;
+    }
+    return stod(json.substr(pos + key.size() + 4));
+}
+
+// Extracts the total time of a phase from the --stats-json output
+double phaseMs(const string& json, const string& phase) {
+    size_t pos = json.find("\"" + phase + "\": {");
+    if (pos == string::npos) {
+        return 0;
+    }
+    return jsonNumber(json.substr(pos), "total_ms");
+}
+
+// Creates an empty temporary file and returns its name
+string tempFile(const string& tag) {
+    const char* dir = getenv("TMPDIR");
+    string pattern = string(dir != NULL ? dir : "/tmp") + "/qo_bench_" + tag + "_XXXXXX";
+    vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+    int fd = mkstemp(name.data());
+    if (fd < 0) {
+        throw runtime_error("could not create temporary file " + pattern);
+    }
+    close(fd);
+    return string(name.data());
+}
+
+// Runs the optimizer on a workload file in a child process and collects its stats and peak memory
+RunResult runOptimizer(const string& optimizer, const string& workload, bool bushy) {
+    RunResult result;
+    string outName = tempFile("out");
+    string errName = tempFile("err");
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int outFd = open(outName.c_str(), O_WRONLY | O_TRUNC);
+        int errFd = open(errName.c_str(), O_WRONLY | O_TRUNC);
+        dup2(outFd, STDOUT_FILENO);
+        dup2(errFd, STDERR_FILENO);
+        if (bushy) {
+            execl(optimizer.c_str(), optimizer.c_str(), "--stats-json", "--bushy", workload.c_str(), (char*)NULL);
+        } else {
+            execl(optimizer.c_str(), optimizer.c_str(), "--stats-json", workload.c_str(), (char*)NULL);
+        }
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage usage;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) < 0) {
+        unlink(outName.c_str());
+        unlink(errName.c_str());
+        return result;
+    }
+    gettimeofday(&end, NULL);
+    result.wallMs = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_usec - start.tv_usec) / 1e3;
+    result.peakKb = usage.ru_maxrss;
+
+    string out = readFile(outName);
+    string err = readFile(errName);
+    unlink(outName.c_str());
+    unlink(errName.c_str());
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return result;
+    }
+    size_t jsonStart = err.rfind("{\"phases\"");
+    if (jsonStart == string::npos) {
+        return result;
+    }
+    string json = err.substr(jsonStart);
+    result.parseMs = phaseMs(json, "parse");
+    result.costingMs = phaseMs(json, "updateOpTbls") + phaseMs(json, "calcOpCosts");
+    result.treeMs = phaseMs(json, "createQueryTree");
+    result.enumerationMs = phaseMs(json, "recurseTree");
+    result.plans = (long)jsonNumber(json, "plans_enumerated");
+
+    // The first cost line belongs to the original tree and the second to the optimized one
+    vector<long> costs;
+    size_t pos = 0;
+    while ((pos = out.find("Cost: ", pos)) != string::npos) {
+        pos += 6;
+        costs.push_back(stol(out.substr(pos)));
+    }
+    if (costs.size() >= 2) {
+        result.regularCost = costs[0];
+        result.optimizedCost = costs[1];
+    }
+    result.ok = true;
+    return result;
+}
+
+// Runs every shape and size of the benchmark matrix and prints one CSV row per run
+int runBenchmark(const string& optimizer, vector<Shape> shapes, vector<int> sizes, WorkloadSpec base, int repeat, bool bushy) {
+    cout << "shape,tables,index_density,rf,bushy,run,ok,wall_ms,parse_ms,costing_ms,tree_ms,enumeration_ms,"
+         << "peak_kb,plans_enumerated,regular_cost,optimized_cost" << endl;
+    int failures = 0;
+    for (unsigned int s = 0; s < shapes.size(); s++) {
+        for (unsigned int n = 0; n < sizes.size(); n++) {
+            for (int run = 0; run < repeat; run++) {
+                WorkloadSpec spec = base;
+                spec.shape = shapes[s];
+                spec.ntables = sizes[n];
+                spec.seed = base.seed + run;
+                string workload = tempFile("workload");
+                {
+                    ofstream out(workload);
+                    generateWorkload(spec, out);
+                }
+                RunResult result = runOptimizer(optimizer, workload, bushy);
+                unlink(workload.c_str());
+                if (!result.ok) {
+                    failures++;
+                }
+                cout << shapeNames[spec.shape] << "," << spec.ntables << "," << spec.indexDensity << ","
+                     << rfNames[spec.rfDist] << "," << (bushy ? 1 : 0) << "," << run << "," << (result.ok ? 1 : 0) << ","
+                     << result.wallMs << "," << result.parseMs << "," << result.costingMs << "," << result.treeMs << ","
+                     << result.enumerationMs << "," << result.peakKb << "," << result.plans << ","
+                     << result.regularCost << "," << result.optimizedCost << endl;
+            }
+        }
+    }
+    if (failures > 0) {
+        cerr << failures << " optimizer runs failed" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    WorkloadSpec spec;
+    string optimizer = "./QueryOptimizer";
+    string generateShape = "";
+    vector<Shape> shapes = {SHAPE_CHAIN, SHAPE_STAR, SHAPE_SNOWFLAKE, SHAPE_CLIQUE};
+    vector<int> sizes = {4, 8, 12, 16};
+    int repeat = 3;
+    bool bushy = false;
+    try {
+        for (int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            if (arg == "--generate" && i + 2 < argc) {
+                generateShape = argv[++i];
+                spec.ntables = stoi(argv[++i]);
+            } else if (arg == "--optimizer" && i + 1 < argc) {
+                optimizer = argv[++i];
+            } else if (arg == "--shapes" && i + 1 < argc) {
+                shapes.clear();
+                vector<string> names = splitList(argv[++i]);
+                for (unsigned int j = 0; j < names.size(); j++) {
+                    shapes.push_back(parseShape(names[j]));
+                }
+            } else if (arg == "--tables" && i + 1 < argc) {
+                sizes.clear();
+                vector<string> items = splitList(argv[++i]);
+                for (unsigned int j = 0; j < items.size(); j++) {
+                    sizes.push_back(stoi(items[j]));
+                }
+            } else if (arg == "--index-density" && i + 1 < argc) {
+                spec.indexDensity = stod(argv[++i]);
+            } else if (arg == "--selection-density" && i + 1 < argc) {
+                spec.selectionDensity = stod(argv[++i]);
+            } else if (arg == "--rf" && i + 1 < argc) {
+                spec.rfDist = parseRFDistribution(argv[++i]);
+            } else if (arg == "--seed" && i + 1 < argc) {
+                spec.seed = stoul(argv[++i]);
+            } else if (arg == "--repeat" && i + 1 < argc) {
+                repeat = stoi(argv[++i]);
+            } else if (arg == "--bushy") {
+                bushy = true;
+            } else {
+                throw invalid_argument("unknown option " + arg);
+            }
+        }
+        if (generateShape != "") {
+            spec.shape = parseShape(generateShape);
+            if (spec.ntables < 1) {
+                throw invalid_argument("a workload needs at least 1 table");
+            }
+            generateWorkload(spec, cout);
+            return 0;
+        }
+        for (unsigned int i = 0; i < sizes.size(); i++) {
+            if (sizes[i] < 1) {
+                throw invalid_argument("a workload needs at least 1 table");
+            }
+        }
+    } catch (const exception& e) {
+        cerr << "Benchmark: " << e.what() << endl;
+        return 1;
+    }
+    return runBenchmark(optimizer, shapes, sizes, spec, repeat, bushy);
+}
@@ -1,1021 +1,7201 @@
-#include <iostream>
-#include <fstream>
-#include <sstream>
-#include <string>
-#include <map>
-#include <vector>
-#include <ios>
-#include <algorithm>
-#include <cctype>
-
-using namespace std;
-
-// For storing reduction factors
-struct RF {
-    string colName;
-    double rfVal = -1;
-};
-
-// For storing indexes
-struct index {
-    string name;
-    int nkeys;
-    double npages; 
-    int height = -1;
-    int min;
-    int max;
-};
-
-// For storing foreign key relationships
-struct fk_relation {
-    string col;
-    string ref_table;
-    string ref_col;
-};
-
-// For storing a table
-class Table {
-    public:
-        string name;
-        vector<string> pks;
-        vector<fk_relation> fks;
-        vector<index> idxs;
-        vector<RF> rfs;
-        vector<string> columns;
-        int ntuples;
-        double npages;
-        double tuplesPerPage;
-        bool isOpTable = false;
-        
-        void setName(string newName) {
-            name = newName;
-        }
-        void addPK(string pk) {
-            pks.push_back(pk);
-
-        }
-        void addFK(fk_relation fk) {
-            fks.push_back(fk);
-        }
-};
-
-// For storing an operation
-class Operation {
-    public:
-        string name;
-        string opType = "";
-        string query;
-        string tbl1 = "";
-        string tbl2 = "";
-        string sel_col;
-        string sel_type;
-        int sel_val;
-        string proj_cols;
-        string join_col1;
-        string join_col2;
-        int ntuples;
-        double npages;
-        double cost;
-        vector<string> inherit_tbls;
-};
-
-// To store the node of a query tree
-class Node {
-    public:
-    Operation* op;
-    Node* parent;
-    Node* left;
-    Node* right;
-    Node(Operation* data) {
-        this->op = data;
-        this->parent = NULL;
-        this->left = NULL;
-        this->right = NULL;
-    }
-};
-
-// Query tree for a given query
-class QueryTree {
-    public:
-        Node* root;
-        QueryTree(Node* root) {
-            this->root = root;
-        }
-};
-
-vector<Table> tables;
-vector<Operation> operations;
-vector<Operation> baseOperations;
-vector<Node> treeNodes;
-Node* treeRoot;
-
-// Finds and returns the node corresponding to an operation
-Node* findNode(string opName) {
-    for (unsigned int i = 0; i < treeNodes.size(); i++) {
-        if (treeNodes[i].op->name == opName) {
-            return &(treeNodes[i]);
-        }
-    }
-    return nullptr;
-}
-
-// Check if a given operation exists
-bool opExists(string opName) {
-    for (unsigned int i = 0; i < operations.size(); i++) {
-        if (operations[i].name == opName) {
-            return true;
-        }
-    }
-    return false;
-}
-
-// Finds and returns an operation
-Operation* findOperation(string opName) {
-    for (unsigned int i = 0; i < operations.size(); i++) {
-        if (operations[i].name == opName) {
-            return &(operations[i]);
-        }
-    }
-    return NULL;
-}
-
-// Finds and returns an RF
-RF* findRF(Table* tbl, string colName) {
-    for (unsigned int i = 0; i < tbl->rfs.size(); i++) {
-        if (tbl->rfs[i].colName == colName) {
-            return &(tbl->rfs[i]);
-        }
-    }
-    return nullptr;
-}
-
-// Finds and returns an index
-index* findIndex(Table* tbl, string idxName) {
-    for (unsigned int i = 0; i < tbl->idxs.size(); i++) {
-        if (tbl->idxs[i].name == idxName) {
-            return &(tbl->idxs[i]);
-        }
-    }
-    return nullptr;
-}
-
-// Finds and returns a table
-Table* findTable(string tableName) {
-    for (unsigned int i = 0; i < tables.size(); i++) {
-        if (tables[i].name == tableName) {
-            return &(tables[i]);
-        }
-    }
-    return nullptr;
-}
-
-// Prints the child nodes of a node in the tree
-void printChildren(Node* root, string link) {
-    if (root == NULL) {
-        return;
-    }
-
-    bool leftExists = (root->left != NULL);
-    bool rightExists = (root->right != NULL);
-
-    // Has no children
-    if (!leftExists && !rightExists) {
-        return;
-    }
-
-    cout << link;
-    cout << ((leftExists && rightExists) ? "├── " : "");
-    cout << ((!leftExists && rightExists) ? "└── " : "");
-
-    if (rightExists) {
-        bool grandChildExists = (leftExists && rightExists && (root->right->right != NULL || root->right->left != NULL));
-        string nextLink = link + (grandChildExists ? "|   " : "    ");
-        cout << root->right->op->name << endl;
-        printChildren(root->right, nextLink);
-    }
-
-    if (leftExists) {
-        cout << (rightExists ? link : "") << "└── " << root->left->op->name << endl;
-        printChildren(root->left, link + "    ");
-    }
-}
-
-// Function for printing the query tree
-void printTree(Node* root) {
-    // Base case
-    if (root == NULL) {
-        return;
-    }
-    cout << root->op->name << endl;
-    printChildren(root, "");
-    cout << endl;
-}
-
-// Finds out whether a node is the left/right child of a join operation in the tree
-string whichChild(Node* parent, Node* child) {
-    if (parent->left->op->name == child->op->name) {
-        return "left";
-    } else {
-        return "right";
-    }
-}
-
-// Pushes selections down the tree
-void pushDownSelections(Node* selNode) {
-    // Find the node that corresponds to the base table of the selection column
-    string baseTblName = "";
-    for (unsigned int i = 0; i < tables.size(); i++) {
-        for (unsigned int j = 0; j < tables[i].columns.size(); j++) {
-            if (tables[i].columns[j] == selNode->op->sel_col) {
-                baseTblName = tables[i].name;
-                break;
-            }
-        }
-        if (baseTblName != "") {
-            break;
-        }
-    }
-    Node* baseTblNode = findNode(baseTblName);
-
-    //Re-link the tree at the location of selection node
-    Node* parentNode = selNode->parent;
-    if (parentNode->op->opType == "SELECTION" || parentNode->op->opType == "PROJECTION") {
-        parentNode->left = selNode->left;
-        selNode->left->parent = parentNode;    
-    } else if (parentNode->op->opType == "JOIN") {
-        // Figure out whether current node is the left/right child
-        if (whichChild(parentNode, selNode) == "left") {
-            parentNode->left = selNode->left; 
-        } else {
-            parentNode->right = selNode->left;  
-        }
-        selNode->left->parent = parentNode;
-    }
-    
-    //Insert selection node before base table
-    if (baseTblNode->parent->op->opType == "JOIN") {
-        if (whichChild(baseTblNode->parent, baseTblNode) == "left") {
-            baseTblNode->parent->left = selNode;
-        } else {
-            baseTblNode->parent->right = selNode;  
-        }
-        selNode->parent = baseTblNode->parent;
-        selNode->left = baseTblNode;
-        baseTblNode->parent = selNode;
-    } else {
-        baseTblNode->parent->left = selNode;
-        selNode->parent = baseTblNode->parent;
-        selNode->left = baseTblNode;
-        baseTblNode->parent = selNode;
-    }
-}
-
-// Moves selections/projections up the query tree to help build pipelined approach
-void updateUnary(Node* node) {
-    // Make sure we're not at the root
-    Node* grandParentNode = node->parent->parent;
-    if (grandParentNode != NULL) {
-        if (grandParentNode->op->opType == "JOIN") {
-            if (whichChild(grandParentNode, node->parent) == "left") {
-                grandParentNode->left = node;
-                if (whichChild(node->parent, node) == "left") {
-                    node->parent->left = node->left;
-                } else {
-                    node->parent->right = node->left;
-                }
-                node->left->parent = node->parent;
-                node->parent->parent = node;
-                node->parent = grandParentNode;
-            } else {
-                grandParentNode->right = node;
-                if (whichChild(node->parent, node) == "left") {
-                    node->parent->left = node->left;
-                } else {
-                    node->parent->right = node->left;
-                }
-                node->left->parent = node->parent;
-                node->parent->parent = node;
-                node->parent = grandParentNode;
-            }
-        } else {
-            Node * tmp = node->parent;
-            grandParentNode->left = node;
-            if (whichChild(node->parent, node) == "left") {
-                node->parent->left = node->left;
-            } else {
-                node->parent->right = node->left;
-            }
-            node->left->parent = node->parent;
-            node->parent->parent = node;
-            node->parent = grandParentNode;
-            node->left = tmp;
-        }
-    } else {
-        node->parent->parent = node;
-        if (whichChild(node->parent, node) == "left") {
-            node->parent->left = node->left;
-        } else {
-            node->parent->right = node->left;
-        }
-        node->left->parent = node->parent;
-        node->left = node->parent;
-        node->parent = NULL;
-        treeRoot = node;        
-    }
-}
-
-// Checks if a column exists in a given table
-bool colExists(Table* tbl, string column) {
-    for (unsigned int i = 0; i < tbl->columns.size(); i++) {
-        if (tbl->columns[i] == column) {
-            return true;
-        }
-    }
-    return false;
-}
-
-// Re-structures the tree to make it left-deep
-void updateJoin(Node* node) {
-    // Base case is when the right side is a base table
-    if (node->right->op->opType == "") {
-        return;
-    }
-    string joinCol = node->op->join_col2;
-    Table* rightTable = findTable(node->right->op->name);
-    if (colExists(rightTable, joinCol)) {
-        Node* tmp = node->parent;
-        node->parent = node->right;
-        node->right = node->right->right;
-        node->right->parent = node;
-        node->parent->right = node->parent->left;
-        node->parent->left = node;
-        if (tmp != NULL) {
-            tmp->left = node->parent;
-        } else {
-            treeRoot = node->parent; 
-        }
-        node->parent->parent = tmp;
-    } else {
-        Node* tmp = node->parent;
-        node->parent = node->right;
-        node->right = node->right->left;
-        node->right->parent = node;
-        node->parent->left = node;
-        if (tmp != NULL) {
-            tmp->left = node->parent;       
-        } else {
-            treeRoot = node->parent; 
-        }
-        node->parent->parent = tmp;
-    }
-    if (node->right->op->opType != "") {
-        updateJoin(node);
-    }
-}
-
-// Wrapper function to restructure the original tree
-void recurseTree(Node* node) {
-    if (node->op->opType == "") {
-        return;
-    }
-    if (node->op->opType == "JOIN") {
-        recurseTree(node->left);
-        recurseTree(node->right);
-        if (node->right->op->opType == "SELECTION" || node->right->op->opType == "PROJECTION") {
-            updateUnary(node->right);
-        } else if (node->left->op->opType == "SELECTION" || node->left->op->opType == "PROJECTION") {
-            updateUnary(node->left);
-        }
-        updateJoin(node);
-    } else {
-        recurseTree(node->left);
-    }
-}
-
-// Returns the cost of the original query
-double regularCost() {
-    double total = 0;
-    for (unsigned int i = 0; i < operations.size(); i++) {
-        if (operations[i].opType == "SELECTION" || operations[i].opType == "PROJECTION" || operations[i].opType == "JOIN") {
-            total += operations[i].cost;
-        }
-    }
-    return total;
-}
-
-// Returns the cost of the optimized query
-double optimizedCost() {
-    double total = 0;
-    for (unsigned int i = 0; i < operations.size(); i++) {
-        if (operations[i].opType == "JOIN") {
-            Node* opNode = findNode(operations[i].name);
-            Table* leftTbl = findTable(opNode->left->op->name);
-            Table* rightTbl = findTable(opNode->right->op->name);
-            if (opNode->left->op->opType == "" && opNode->right->op->opType == "") {
-                bool innerIdxExists = false;
-                // Check for index on inner table
-                for (unsigned int i = 0; i < rightTbl->idxs.size(); i++) {
-                    if (rightTbl->idxs[i].name == operations[i].join_col2) {
-                        innerIdxExists = true;
-                    }
-                }
-                if (innerIdxExists) {
-                    total += leftTbl->npages + (leftTbl->ntuples*1.2);
-                } else {
-                    total += leftTbl->npages + (leftTbl->ntuples*rightTbl->npages);
-                }
-            } else if (opNode->left->op->opType != "" && opNode->right->op->opType == "") {
-                total += rightTbl->npages;
-            }
-        } else if (operations[i].opType == "SELECTION" || operations[i].opType == "PROJECTION") {
-            Node* opNode = findNode(operations[i].name);
-            Table* leftTbl = findTable(opNode->left->op->name);
-            if (opNode->left->op->opType == "") {
-                total += leftTbl->npages;
-            }
-        }
-    }
-    return total;
-}
-
-// Constructs the tree for the original query
-void constructTree(Node* node) {
-    if (node->op->opType == "JOIN") {
-        //Check if left, right tables of join operation are base tables
-        Node* leftNode = findNode(node->op->tbl1);
-        Node* rightNode = findNode(node->op->tbl2);
-        node->left = leftNode;
-        node->right = rightNode;
-        leftNode->parent = node;
-        rightNode->parent = node;
-    } else if (node->op->opType == "SELECTION" || node->op->opType == "PROJECTION") {
-        Node* leftNode = findNode(node->op->tbl1);
-        node->left = leftNode;
-        leftNode->parent = node;
-    }
-}
-
-// Adds the nodes for base tables
-void pushBaseNode(string tblName) {
-    Operation* baseTblOp = new Operation();
-    baseTblOp->name = tblName;
-    baseOperations.push_back(*baseTblOp);
-    Node baseTblNode(baseTblOp);
-    treeNodes.push_back(baseTblNode);
-}
-
-// Adds the nodes for operations
-void pushOpNode(string opName) {
-    Operation* currOp = findOperation(opName);
-    Node opNode(currOp);
-    treeNodes.push_back(opNode);
-}
-
-// Creates the nodes of the tree
-void createBaseTblNodes() {
-    for (unsigned int i = 0; i < tables.size(); i++) {
-        if (findOperation(tables[i].name) == NULL && tables[i].name != "RESULT") {
-            pushBaseNode(tables[i].name);
-        }
-    }
-    for (unsigned int i = 0; i < operations.size(); i++) {
-        pushOpNode(operations[i].name);
-    } 
-}
-
-// Creates the query tree
-QueryTree* createQueryTree() {
-    createBaseTblNodes();
-    for (unsigned int i = 0; i < treeNodes.size(); i++) {
-        constructTree(&(treeNodes[i]));
-    }
-    Node* resultNode = findNode("RESULT");
-    QueryTree qt(resultNode);
-    return &qt;
-}
-
-// Sets the name of a table
-void setTableName(string statement, Table* tbl) {
-    int nameStart = statement.find("TABLE") + 6;
-    int nameEnd = statement.find("(");
-    string tableName = statement.substr(nameStart, nameEnd-nameStart);
-    tbl->setName(tableName);
-}
-
-// Sets the primary keys of a table
-void getPrimaryKeys(string statement, Table* tbl) {
-    int pkStart = statement.find("PRIMARY KEY") + 12;
-    int pkEnd = statement.find(")");
-    string pkUnparsed = statement.substr(pkStart, pkEnd-pkStart);
-    stringstream ss(pkUnparsed);
-    string currPK;
-    while (getline(ss, currPK, ' ')) {
-        string finPK = currPK;
-        if (currPK.back() == ',') {
-            finPK = currPK.substr(0, currPK.size()-1);
-        }
-        tbl->addPK(finPK);
-    }
-}
-
-// Sets the columns of a table
-void getColumns (string statement, Table* tbl) {
-    int colStart = statement.find_first_of('(');
-    int colEnd = statement.find("PRIMARY KEY");
-    string colsOnly = statement.substr(colStart+1, colEnd-colStart-2);
-    stringstream ss (colsOnly);
-        string currCol;
-        while (getline(ss, currCol, ',')) {
-            tbl->columns.push_back(currCol);
-        }
-}
-
-// Copies indexes from one table to another
-void copyTableIdxs(Table* newTbl, Table* existingTbl) {
-    for (unsigned int i = 0; i < existingTbl->idxs.size(); i++) {
-        newTbl->idxs.push_back(existingTbl->idxs[i]);
-    }
-}
-
-// Copies RFs from one table to another
-void copyTableRfs(Table* newTbl, Table* existingTbl) {
-    for (unsigned int i = 0; i < existingTbl->rfs.size(); i++) {
-        newTbl->rfs.push_back(existingTbl->rfs[i]);
-    }
-}
-
-// Copies PKs from one table to another
-void copyTablePks(Table* newTbl, Table* existingTbl) {
-    for (unsigned int i = 0; i < existingTbl->pks.size(); i++) {
-        newTbl->pks.push_back(existingTbl->pks[i]);
-    }
-}
-
-// Copies FKs from one table to another
-void copyTableFks(Table* newTbl, Table* existingTbl) {
-    for (unsigned int i = 0; i < existingTbl->fks.size(); i++) {
-        newTbl->fks.push_back(existingTbl->fks[i]);
-    }
-}   
-
-// Sets the tuples per page for each table
-void updateRegTbls() {
-    for (unsigned int i = 0; i < tables.size(); i++) {
-        if (tables[i].isOpTable == false) {
-            tables[i].tuplesPerPage = tables[i].ntuples/tables[i].npages;
-        }
-    }
-}
-
-// Update the operation tables to preserve RFs, PKs, and FKs
-void updateOpTbls() {
-    for (unsigned int i = 0; i < operations.size(); i++) {
-        Table* opTable = findTable(operations[i].name);
-        for (unsigned int j = 0; j < operations[i].inherit_tbls.size(); j++) {
-            Table* toInherit = findTable(operations[i].inherit_tbls[j]);
-           // copyTableIdxs(opTable, toInherit);
-            copyTableRfs(opTable, toInherit);
-            copyTablePks(opTable, toInherit);
-            copyTableFks(opTable, toInherit);
-        }
-    }
-}
-
-// Function for calculating cost of operations
-void calcOpCosts() {
-    for (unsigned int i = 0; i < operations.size(); i++) {
-       // cout << "Currently on operation " << operations[i].name << endl;
-        Operation* op = &(operations[i]);
-        Table* opTable = findTable(op->name);
-        if (op->opType == "JOIN") {
-            // We assume that tbl1 is the outer table
-            Table* tbl1 = findTable(op->tbl1);
-            Table* tbl2 = findTable(op->tbl2);
-            // Look for an index on the inner table (tbl2)
-            bool innerIdxExists = false;
-                for (unsigned int i = 0; i < tbl2->idxs.size(); i++) {
-                    if (tbl2->idxs[i].name == op->join_col2) {
-                        innerIdxExists = true;
-                    }
-                }
-            if (innerIdxExists == true) {
-                double costToMatch = 1.2;
-                op->cost = tbl1->npages + (tbl1->ntuples * costToMatch);
-            } else {
-                op->cost = tbl1->npages + (tbl1->ntuples * tbl2->npages);
-            }
-            // Get the RF of this join condition
-            RF* tbl1_RF = findRF(tbl1, op->join_col1);
-            RF* tbl2_RF = findRF(tbl2, op->join_col2);
-            double joinRF = tbl1_RF->rfVal*tbl2_RF->rfVal;
-            index* tbl1_idx = findIndex(tbl1, op->join_col1);
-            index* tbl2_idx = findIndex(tbl1, op->join_col1);
-            if (tbl1_idx != nullptr && tbl2_idx != nullptr) {
-                joinRF = 1/(max(tbl1_idx->nkeys, tbl2_idx->nkeys));
-            }
-            opTable->ntuples = (tbl1->ntuples*tbl2->ntuples)*(joinRF);
-            opTable->npages = op->cost;
-        } else {
-            Table* tbl1 = findTable(op->tbl1);
-            if (op->opType == "SELECTION") {
-                int readFileCost = tbl1->npages;
-                RF* selColRF = findRF(opTable, op->sel_col);
-                opTable->ntuples = tbl1->ntuples*selColRF->rfVal;
-                opTable->tuplesPerPage = tbl1->tuplesPerPage;
-                // Check if index exists on selection column
-                // If it does, cost changes (as we dont have to write to temp)
-                for (unsigned int i = 0; i < tbl1->idxs.size(); i++) {
-                    if (tbl1->idxs[i].name == op->sel_col) {
-                        if (op->sel_type == "=") {
-                            readFileCost = (tbl1->ntuples/tbl1->idxs[i].nkeys)/tbl1->tuplesPerPage;
-                            opTable->ntuples = tbl1->ntuples/(tbl1->idxs[i].nkeys);
-                        } else if (op->sel_type == ">") {
-                            double idxRF = (tbl1->idxs[i].max-(op->sel_val))/(tbl1->idxs[i].max - tbl1->idxs[i].min);
-                            readFileCost = (tbl1->ntuples*(idxRF))/tbl1->tuplesPerPage;
-                        }
-                    }
-                }
-                op->cost = readFileCost;
-                opTable->npages = op->cost;
-                // If we are selecting from an existing operation, use on-the-fly
-                if (tbl1->isOpTable == true) {
-                    op->cost = 0;
-                }
-            } else if (op->opType == "PROJECTION") {
-                // Perform projections on-the-fly, cost is zero as the input is pipelined.
-                // However we must file scan if the projection is happening on a base table.
-                Table* tbl1 = findTable(op->tbl1);
-                op->cost = 0;
-                if (tbl1->isOpTable == false) {
-                    op->cost = tbl1->npages; 
-                }
-                opTable->ntuples = tbl1->ntuples;
-
-                //Calculate the number of pages produced by this projection operation
-                stringstream ss (op->proj_cols);
-                string currCol;
-                double totalRF = 1;
-                while (getline(ss, currCol, ',')) {
-                    RF* currRF = findRF(tbl1, currCol);
-                    totalRF *= currRF->rfVal;
-                }
-
-                opTable->npages = (tbl1->npages)*totalRF;
-            }
-        }
-    }
-}
-
-
-// Processes table statement and stores details
-void processTable(string statement) {
-    Table newTbl;
-    setTableName(statement, &newTbl);
-    getPrimaryKeys(statement, &newTbl);
-    getColumns(statement, &newTbl);
-    newTbl.isOpTable = false;
-    tables.push_back(newTbl);
-}
-
-// Processes foreign key statement and stores details
-void processForeign(string statement) {
-    // Obtain only what's inside the outermost brackets
-    int stmtStart = statement.find("(");
-    int stmtEnd = statement.size();
-    string cutStmt = statement.substr(stmtStart+1, stmtEnd-stmtStart-3);
-
-    // Getting table name and fk column
-    int tblEnd = cutStmt.find("(");
-    int colEnd = cutStmt.find(")");
-    string tableName = cutStmt.substr(0, tblEnd);
-    string colName = cutStmt.substr(tblEnd+1, colEnd-tblEnd-1);
-
-    // Getting referenced table and column
-    int refStart = cutStmt.find("REFERENCES");
-    string refStmt = cutStmt.substr(refStart);
-    int refTblStart = refStmt.find(" ") + 1;
-    int refTblEnd = refStmt.find("(");
-    int refEnd = refStmt.find(")");
-    string refTable = refStmt.substr(refTblStart, refTblEnd-refTblStart);
-    string refCol = refStmt.substr(refTblEnd+1, refEnd-refTblEnd-1);
-
-    // Storing results
-    for (unsigned int i = 0; i < tables.size(); i++) {
-        if (tables[i].name == tableName) {
-            fk_relation fk;
-            fk.col = colName;
-            fk.ref_col = refCol;
-            fk.ref_table = refTable;
-            tables[i].addFK(fk);
-        }
-    }
-}
-
-// Function to process OPERATION statement
-void processOP (string operationStr) {
-    // Finding the type of operation
-    Operation newOp;
-    string parseOp;
-    int equalLoc = operationStr.find('=');
-    string tableName = operationStr.substr(0, equalLoc-1);
-    (&newOp)->name = tableName;
-    string rightSide = operationStr.substr(equalLoc + 1);
-    istringstream iss(rightSide);
-    iss >> parseOp; //Table1
-    (&newOp)->tbl1 = parseOp;
-    iss >> parseOp; //Operation Type
-    (&newOp)->opType = parseOp;
-
-    // Parse various types of operations
-    if (newOp.opType == "SELECTION") {
-        iss >> parseOp;
-        string selCol;
-        string selType;
-        int selVal;
-        if (parseOp.find('=') != string::npos) {
-            int eqLoc = parseOp.find('=');
-            selCol = parseOp.substr(0, eqLoc);
-            selType = '=';
-            selVal = stoi(parseOp.substr(eqLoc+1));
-        } else if (parseOp.find('>') != string::npos) {
-            int gtLoc = parseOp.find('>');
-            selCol = parseOp.substr(0, gtLoc);
-            selType = '>';
-            selVal = stoi(parseOp.substr(gtLoc+1));
-        }
-        (&newOp)->sel_col = selCol;
-        (&newOp)->sel_type = selType;
-        (&newOp)->sel_val = selVal;
-        (&newOp)->inherit_tbls.push_back((&newOp)->tbl1);
-    } else if (newOp.opType == "PROJECTION") {
-        iss >> parseOp;
-        (&newOp)->proj_cols = parseOp;
-        (&newOp)->inherit_tbls.push_back((&newOp)->tbl1);
-    } else if (newOp.opType == "JOIN") {
-        iss >> parseOp;
-        (&newOp)->tbl2 = parseOp;
-        iss >> parseOp;
-        iss >> parseOp;
-        int eqLoc = parseOp.find('=');
-        string col1 = parseOp.substr(0,eqLoc);
-        string col2 = parseOp.substr(eqLoc+1);
-        (&newOp)->join_col1 = col1;
-        (&newOp)->join_col2 = col2;
-        (&newOp)->inherit_tbls.push_back((&newOp)->tbl1);
-        (&newOp)->inherit_tbls.push_back((&newOp)->tbl2);
-    }
-    Table newTbl;
-    newTbl.name = newOp.name;
-    newTbl.isOpTable = true;
-    tables.push_back(newTbl);
-    operations.push_back(newOp);
-}
-
-// Function to process CARDINALITY statement
-void processCard(string statement) {
-    int start = statement.find_first_of('(');
-    int end = statement.find_last_of(')');
-    string inBracket = statement.substr(start+1, end-start-1);
-    int eqLoc = statement.find('=');
-    string rhs = statement.substr(eqLoc+1);
-    string cardValStr;
-    istringstream iss(rhs);
-    iss >> cardValStr;
-    int cardVal = stoi(cardValStr);
-
-    // Check if Cardinality of TABLE or Index Column
-    if (inBracket.find(" IN ") == string::npos) {
-        Table* tbl = findTable(inBracket);
-        tbl->ntuples = cardVal;
-    } else {
-        // Check for multi-attribute index
-        string parseCard;
-        if (inBracket.find('(') == string::npos) {  
-            string idx_col;
-            istringstream iss2(inBracket);
-            iss2 >> parseCard;
-            idx_col = parseCard;
-            iss2 >> parseCard;
-            iss2 >> parseCard;
-            Table* tbl = findTable(parseCard);
-            index idx;
-            idx.name = idx_col;
-            idx.nkeys = cardVal;
-            tbl->idxs.push_back(idx);
-        } else {
-            int inStart = inBracket.find('(');
-            int inEnd = inBracket.find(')');
-            string idx_col = inBracket.substr(inStart+1, inEnd-inStart-1);
-            string inTable = inBracket.substr(inEnd+1);
-            istringstream iss2(inTable);
-            iss2 >> parseCard;
-            iss2 >> parseCard;
-            Table* tbl = findTable(parseCard);
-            index idx;
-            idx.name = idx_col;
-            idx.nkeys = cardVal;
-            tbl->idxs.push_back(idx);
-        }
-    }
-}
-
-// Function to process SIZE statement
-void processSize(string statement) {
-    int start = statement.find_first_of('(');
-    int end = statement.find_last_of(')');
-    string inBracket = statement.substr(start+1, end-start-1);
-    int eqLoc = statement.find('=');
-    string rhs = statement.substr(eqLoc+1);
-    string sizeValStr;
-    istringstream iss(rhs);
-    iss >> sizeValStr;
-    double sizeVal = stod(sizeValStr);
-
-    // Check if Size of TABLE or Index Column
-    if (inBracket.find(" IN ") == string::npos) {
-        Table* tbl = findTable(inBracket);
-        tbl->npages = sizeVal;
-    } else {
-        // Check for multi-attribute index
-        string parseSize;
-        if (inBracket.find('(') == string::npos) { 
-            string idx_col;
-            istringstream iss2(inBracket);
-            iss2 >> parseSize; // Col
-            idx_col = parseSize;
-            iss2 >> parseSize; // in
-            iss2 >> parseSize; // Table
-            Table* tbl = findTable(parseSize);
-            index* idx = findIndex(tbl, idx_col);
-            idx->npages = sizeVal;
-        } else {
-            int inStart = inBracket.find('(');
-            int inEnd = inBracket.find(')');
-            string idx_col = inBracket.substr(inStart+1, inEnd-inStart-1);
-            string inTable = inBracket.substr(inEnd+1);
-            istringstream iss2(inTable);
-            iss2 >> parseSize;
-            iss2 >> parseSize;
-            Table* tbl = findTable(parseSize);
-            index* idx = findIndex(tbl, idx_col);
-            idx->npages = sizeVal;
-        }
-    }
-}
-
-// Function to process SIZE statement
-void processRF(string statement) {
-    int start = statement.find_first_of('(');
-    int end = statement.find_last_of(')');
-    string inBracket = statement.substr(start+1, end-start-1);
-    int eqLoc = statement.find('=');
-    string rhs = statement.substr(eqLoc+1);
-    string rfValStr;
-    istringstream iss(rhs);
-    iss >> rfValStr;
-    double rf_Val = stod(rfValStr);
-
-    string parseRF;
-    string col;
-    istringstream iss2(inBracket);
-    iss2 >> parseRF;
-    col = parseRF;   // Col
-    iss2 >> parseRF; // in
-    iss2 >> parseRF; // Table
-    Table* tbl = findTable(parseRF);
-    RF currRF;
-    currRF.colName = col;
-    currRF.rfVal = rf_Val;
-    tbl->rfs.push_back(currRF);
-}
-
-// Function to process HEIGHT statement
-void processHeight(string statement) {
-    int start = statement.find_first_of('(');
-    int end = statement.find_last_of(')');
-    string inBracket = statement.substr(start+1, end-start-1);
-    int eqLoc = statement.find('=');
-    string rhs = statement.substr(eqLoc+1);
-    string heightValStr;
-    istringstream iss(rhs);
-    iss >> heightValStr;
-    int heightVal = stoi(heightValStr);
-
-    string parseHeight;
-        if (inBracket.find('(') == string::npos) {  
-            string idx_col;
-            istringstream iss2(inBracket);
-            iss2 >> parseHeight;
-            idx_col = parseHeight;
-            iss2 >> parseHeight;
-            iss2 >> parseHeight;
-            Table* tbl = findTable(parseHeight);
-            index* idx = findIndex(tbl, idx_col);
-            idx->height = heightVal;
-        } else {
-            int inStart = inBracket.find('(');
-            int inEnd = inBracket.find(')');
-            string idx_col = inBracket.substr(inStart+1, inEnd-inStart-1);
-            string inTable = inBracket.substr(inEnd+1);
-            istringstream iss2(inTable);
-            iss2 >> parseHeight;
-            iss2 >> parseHeight;
-            Table* tbl = findTable(parseHeight);
-            index* idx = findIndex(tbl, idx_col);
-            idx->height = heightVal;
-        }    
-}
-
-// Function to process RANGE statement
-void processRange(string statement) {
-    int start = statement.find_first_of('(');
-    int end = statement.find_last_of(')');
-    string inBracket = statement.substr(start+1, end-start-1);
-    int eqLoc = statement.find('=');
-    string rhs = statement.substr(eqLoc+1);
-    string rangeStr;
-    istringstream iss(rhs);
-    iss >> rangeStr;
-    stringstream ss(rangeStr);
-    string currVal;
-    vector<int> minMax;
-    while (getline(ss >> ws, currVal, ',')) {
-        minMax.push_back(stoi(currVal));
-    }
-    int minVal = minMax[0];
-    int maxVal = minMax[1];
-    
-    string parseRange;
-    string idx_col;
-    istringstream iss2(inBracket);
-    iss2 >> parseRange;
-    idx_col = parseRange;
-    iss2 >> parseRange;
-    iss2 >> parseRange;
-    Table* tbl = findTable(parseRange);
-    index* idx = findIndex(tbl, idx_col);
-    idx->min = minVal;
-    idx->max = maxVal;
-}
-
-// Function to process all statement
-void processStatement(string statement) {
-    if (statement.substr(0, 2) == "OP" || statement.substr(0, 6) == "RESULT") {
-        processOP(statement);
-    } else if (statement.substr(0, 5) == "TABLE") {
-        processTable(statement);
-    } else if (statement.substr(0, 7) == "FOREIGN") {
-        processForeign(statement);
-    } else if (statement.substr(0, 11) == "CARDINALITY") {
-        processCard(statement);
-    } else if (statement.substr(0, 4) == "SIZE") {
-        processSize(statement);
-    } else if (statement.substr(0, 2) == "RF") {
-        processRF(statement);
-    } else if (statement.substr(0, 6) == "Height") {
-        processHeight(statement);
-    } else if (statement.substr(0, 5) == "RANGE" || statement.substr(0, 5) == "Range") {
-        processRange(statement);
-    }
-}
-
-int main (int argc, char** argv) {
-    if (argc != 2) {
-        cerr << "Please pass 1 input file to the program" << endl;
-    }
-    string line;
-    string whitespace = " ";
-    ifstream inputFile(argv[1]);
-   
-    while (getline(inputFile, line)) {
-        if (line != "") {
-            // Getting rid of any whitespace at the beginning of a line
-            size_t starting = line.find_first_not_of(whitespace);
-            string statement = line.substr(starting);
-            transform(statement.begin(), statement.end(), statement.begin(), ::toupper);
-            processStatement(statement);
-        }
-    }
-    updateRegTbls();
-    updateOpTbls();
-    calcOpCosts();
-    QueryTree* qt = createQueryTree();
-    Node* currRoot = findNode("RESULT");
-    treeRoot = currRoot;
-    // Before changes
-    cout << "--------------" << endl;
-    cout << "| Query Tree |" << endl;
-    cout << "--------------" << endl;
-    cout << endl;
-    printTree(treeRoot);
-    cout << "Cost: " << (long)regularCost() << " I/Os" << endl;
-    cout << endl;
-    cout << "------------------------" << endl;
-    cout << "| Optimized Query Tree |" << endl;
-    cout << "------------------------" << endl;
-    cout << endl;
-    recurseTree(treeRoot);
-    printTree(treeRoot);
-    cout << "Cost: " << (long)optimizedCost() << " I/Os" << endl;
-    cout << endl;
-}
\ No newline at end of file
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <vector>
+#include <ios>
+#include <iomanip>
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <charconv>
+#include <stdexcept>
+#include <unordered_map>
+#include <list>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <random>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Interned names of every column and index seen in the input
+unordered_map<string, int> columnIds;
+vector<string> columnNames;
+
+// Returns the ID of a column name, interning it if it is new
+int internColumn(const string& colName) {
+    auto it = columnIds.find(colName);
+    if (it != columnIds.end()) {
+        return it->second;
+    }
+    columnIds[colName] = columnNames.size();
+    columnNames.push_back(colName);
+    return columnNames.size() - 1;
+}
+
+// Returns the ID of a column name, or -1 if it has never been seen
+int lookupColumn(const string& colName) {
+    auto it = columnIds.find(colName);
+    return (it != columnIds.end()) ? it->second : -1;
+}
+
+// For storing reduction factors
+struct RF {
+    string colName;
+    double rfVal = -1;
+};
+
+// For storing the average width of a column's values in bytes
+struct ColumnWidth {
+    string colName;
+    double bytes = -1;
+};
+
+// For storing indexes
+struct Index {
+    string name;
+    int nkeys = 0;
+    double npages = 0; 
+    int height = -1;
+    int min = 0;
+    int max = 0;
+};
+
+// For storing the value distribution of a column
+// Most common values are kept sorted with the cumulative frequency up to each of them. The equi-depth
+// histogram describes the remaining tuples as sorted bucket boundaries plus the cumulative fraction of
+// those tuples up to each boundary
+struct ColumnStats {
+    string colName;
+    vector<double> mcvValues;
+    vector<double> mcvCumFreqs;
+    vector<double> bounds;
+    vector<double> cumFreqs;
+};
+
+// For storing foreign key relationships
+struct fk_relation {
+    string col;
+    string ref_table;
+    string ref_col;
+};
+
+// For storing a table
+class Table {
+    public:
+        int id = -1;
+        string name;
+        vector<string> pks;
+        vector<fk_relation> fks;
+        vector<Index> idxs;
+        vector<RF> rfs;
+        vector<ColumnStats> colStats;
+        vector<ColumnWidth> widths;
+        vector<string> columns;
+        int ntuples = 0;
+        double npages = 0;
+        double tuplesPerPage = 0;
+        bool isOpTable = false;
+        // Catalog version of the last statement that changed the table
+        long version = 0;
+        // Column ID -> position in columns/idxs/rfs
+        unordered_map<int, int> colSlots;
+        unordered_map<int, int> idxSlots;
+        unordered_map<int, int> rfSlots;
+        unordered_map<int, int> statSlots;
+        unordered_map<int, int> widthSlots;
+        
+        void setName(string newName) {
+            name = newName;
+        }
+        void addPK(string pk) {
+            pks.push_back(pk);
+
+        }
+        void addFK(fk_relation fk) {
+            fks.push_back(fk);
+        }
+        void addColumn(string col) {
+            colSlots[internColumn(col)] = columns.size();
+            columns.push_back(col);
+        }
+        // Lookups return the first entry for a column, so later duplicates are not indexed
+        void addIndex(Index idx) {
+            idxSlots.insert({internColumn(idx.name), (int)idxs.size()});
+            idxs.push_back(idx);
+        }
+        void addRF(RF rf) {
+            rfSlots.insert({internColumn(rf.colName), (int)rfs.size()});
+            rfs.push_back(rf);
+        }
+        void addColumnStats(ColumnStats stats) {
+            statSlots.insert({internColumn(stats.colName), (int)colStats.size()});
+            colStats.push_back(stats);
+        }
+        void addWidth(ColumnWidth width) {
+            widthSlots.insert({internColumn(width.colName), (int)widths.size()});
+            widths.push_back(width);
+        }
+};
+
+// For storing every table along with hash indexes over table and column names
+class Catalog {
+    public:
+        vector<Table> tables;
+        unordered_map<string, int> tableIds;
+        // Column ID -> ID of the first base table that declares it
+        vector<int> columnOwner;
+
+        Table* addTable(Table tbl) {
+            tbl.id = tables.size();
+            tableIds[tbl.name] = tbl.id;
+            for (unsigned int i = 0; i < tbl.columns.size(); i++) {
+                int colId = internColumn(tbl.columns[i]);
+                if ((int)columnOwner.size() <= colId) {
+                    columnOwner.resize(colId + 1, -1);
+                }
+                if (columnOwner[colId] == -1) {
+                    columnOwner[colId] = tbl.id;
+                }
+            }
+            tables.push_back(move(tbl));
+            return &(tables.back());
+        }
+        Table* findTable(const string& tableName) {
+            auto it = tableIds.find(tableName);
+            return (it != tableIds.end()) ? &(tables[it->second]) : nullptr;
+        }
+        Table* columnTable(const string& colName) {
+            int colId = lookupColumn(colName);
+            if (colId == -1 || colId >= (int)columnOwner.size() || columnOwner[colId] == -1) {
+                return nullptr;
+            }
+            return &(tables[columnOwner[colId]]);
+        }
+};
+
+// Ways of reading a base table for a selection or projection
+enum AccessMethod { ACCESS_NONE, ACCESS_HEAP_SCAN, ACCESS_INDEX_PROBE, ACCESS_INDEX_ONLY };
+
+// For storing the access path chosen for an operation on a base table
+struct AccessPath {
+    AccessMethod method = ACCESS_NONE;
+    string index;
+    double cost = 0;
+    // Fraction of the table matched according to the index statistics, -1 if unknown
+    double fraction = -1;
+};
+
+// Describes an access path for printing
+string accessPathName(const AccessPath& path) {
+    switch (path.method) {
+        case ACCESS_HEAP_SCAN:
+            return "heap scan";
+        case ACCESS_INDEX_PROBE:
+            return "index probe on " + path.index;
+        case ACCESS_INDEX_ONLY:
+            return "index-only scan on " + path.index;
+        default:
+            return "";
+    }
+}
+
+// Physical join algorithms
+enum JoinMethod { JOIN_NONE, JOIN_NESTED_LOOP, JOIN_INDEX_NESTED_LOOP, JOIN_BLOCK_NESTED_LOOP, JOIN_SORT_MERGE, JOIN_HASH };
+const char* joinMethodNames[] = {"", "nested loop join", "index nested loop join", "block nested loop join", "sort-merge join", "hash join"};
+
+// Buffer pool pages available to sorts and joins (--buffer-pages)
+int bufferPages = 100;
+
+// Coefficients of the cost model, in units of one sequentially read page
+// The defaults are the textbook model that only counts page I/Os; --calibrate fits them to the machine and
+// --cost-profile loads the result
+struct CostProfile {
+    double seqPage = 1;
+    double randomPage = 1;
+    double writePage = 1;
+    double indexProbe = 1.2;
+    double cpuTuple = 0;
+    double hashTuple = 0;
+    double sortTuple = 0;
+};
+CostProfile costProfile;
+
+// For storing an operation
+class Operation {
+    public:
+        string name;
+        string opType = "";
+        string query;
+        string tbl1 = "";
+        string tbl2 = "";
+        string sel_col;
+        // One of =, <>, <, <=, >, >=, BETWEEN or IN
+        string sel_type;
+        int sel_val;
+        // Upper bound of a BETWEEN, and the sorted values of an IN-list
+        int sel_hi = 0;
+        vector<int> sel_list;
+        string proj_cols;
+        string join_col1;
+        string join_col2;
+        // Estimated output rows of the node this operation is placed at
+        double ntuples = 0;
+        double npages;
+        double cost;
+        AccessPath access;
+        JoinMethod joinMethod = JOIN_NONE;
+        vector<string> inherit_tbls;
+};
+
+// To store the node of a query tree
+class Node {
+    public:
+    Operation* op;
+    Node* parent;
+    Node* left;
+    Node* right;
+    Node(Operation* data) {
+        this->op = data;
+        this->parent = NULL;
+        this->left = NULL;
+        this->right = NULL;
+    }
+};
+
+// Pool that hands out objects in fixed-size chunks so their addresses never move
+template <typename T>
+class ChunkPool {
+    public:
+        static const int CHUNK_SIZE = 256;
+
+        ChunkPool() {}
+        ChunkPool(const ChunkPool&) = delete;
+        ChunkPool& operator=(const ChunkPool&) = delete;
+
+        // Stores a copy of an item and returns its stable address
+        T* add(const T& item) {
+            if (count % CHUNK_SIZE == 0) {
+                chunks.emplace_back();
+                chunks.back().reserve(CHUNK_SIZE);
+            }
+            // A chunk never grows past its reserved capacity, so it is never reallocated
+            chunks.back().push_back(item);
+            count++;
+            return &(chunks.back().back());
+        }
+        T& operator[](int i) {
+            return chunks[i / CHUNK_SIZE][i % CHUNK_SIZE];
+        }
+        int size() {
+            return count;
+        }
+        // Frees every item in one step
+        void clear() {
+            chunks.clear();
+            count = 0;
+        }
+
+    private:
+        vector<vector<T>> chunks;
+        int count = 0;
+};
+
+// Query tree for a given query, owning the arena its nodes live in
+class QueryTree {
+    public:
+        Node* root = NULL;
+        ChunkPool<Node> nodes;
+        ChunkPool<Operation> baseOps;
+        // Operations the rewrites add to the tree, such as the projections pushed below joins
+        ChunkPool<Operation> addedOps;
+        // Operation name -> index of its node in the arena
+        unordered_map<string, int> nodeIds;
+
+        // Frees the whole plan so the tree can be reused for another query
+        void clear() {
+            root = NULL;
+            nodes.clear();
+            baseOps.clear();
+            addedOps.clear();
+            nodeIds.clear();
+        }
+};
+
+Catalog catalog;
+// Bumped whenever a catalog statement changes the schema or statistics
+long catalogVersion = 0;
+// For storing the estimated output size of a base table or an operation
+// Widths are in bytes; every output column keeps its width and its number of distinct values
+struct SizeEstimate {
+    double ntuples = 0;
+    double npages = 0;
+    double width = 0;
+    vector<string> columns;
+    vector<double> colWidths;
+    vector<double> distinct;
+};
+
+// For storing a semi-join reduction: the scan of a table only passes on the rows whose join column may match
+// a key of another table that survives the selections on it, tested with a bloom filter of those keys
+struct SemiJoin {
+    string table;
+    string col;
+    string keyTable;
+    string keyCol;
+    vector<Operation*> filters;
+    // Estimated fraction of the scanned rows that pass
+    double fraction = 1;
+    bool active = false;
+};
+
+// Per-query state, kept apart from the catalog so it can be thrown away after each query
+// The catalog is read-only while queries are optimized, so each thread only writes its own context
+class QueryContext {
+    public:
+        // Tables produced by the operations of the query
+        Catalog opTables;
+        vector<Operation> operations;
+        unordered_map<string, int> operationIds;
+        QueryTree tree;
+        // Table or operation name -> estimated output size
+        unordered_map<string, SizeEstimate> sizes;
+        vector<SemiJoin> semiJoins;
+
+        void clear() {
+            tree.clear();
+            opTables = Catalog();
+            operations.clear();
+            operationIds.clear();
+            sizes.clear();
+            semiJoins.clear();
+        }
+};
+
+thread_local QueryContext query;
+
+// Optimizer phases and counters reported by --stats and --stats-json
+enum StatPhase {PHASE_PARSE, PHASE_REG_TABLES, PHASE_OP_TABLES, PHASE_COSTING, PHASE_TREE, PHASE_REWRITE, PHASE_OPT_COST, NUM_PHASES};
+enum StatCounter {COUNT_STATEMENTS, COUNT_QUERIES, COUNT_LOOKUPS, COUNT_NODES, COUNT_REWRITES, COUNT_PLANS, COUNT_REUSED, NUM_COUNTERS};
+
+const char* phaseNames[NUM_PHASES] = {"parse", "updateRegTbls", "updateOpTbls", "calcOpCosts", "createQueryTree", "recurseTree", "optimizedCost"};
+const char* counterNames[NUM_COUNTERS] = {"statements", "queries", "catalog_lookups", "nodes_created", "rewrites_applied", "plans_enumerated", "subsets_reused"};
+
+// For storing the time spent in each phase and the counters of one or more threads
+class OptimizerStats {
+    public:
+        long long phaseNanos[NUM_PHASES] = {};
+        long phaseCalls[NUM_PHASES] = {};
+        long counters[NUM_COUNTERS] = {};
+
+        void merge(const OptimizerStats& other) {
+            for (int i = 0; i < NUM_PHASES; i++) {
+                phaseNanos[i] += other.phaseNanos[i];
+                phaseCalls[i] += other.phaseCalls[i];
+            }
+            for (int i = 0; i < NUM_COUNTERS; i++) {
+                counters[i] += other.counters[i];
+            }
+        }
+};
+
+// Phase timers only read the clock when --stats or --stats-json is given
+bool collectStats = false;
+// Each thread counts into its own stats, which are folded into the totals after every query
+thread_local OptimizerStats localStats;
+OptimizerStats totalStats;
+mutex statsLock;
+
+// Adds the current thread's stats to the totals and resets them
+void flushStats() {
+    lock_guard<mutex> guard(statsLock);
+    totalStats.merge(localStats);
+    localStats = OptimizerStats();
+}
+
+// Times the enclosing scope as one call of a phase
+class PhaseTimer {
+    public:
+        StatPhase phase;
+        chrono::steady_clock::time_point start;
+
+        PhaseTimer(StatPhase timedPhase) : phase(timedPhase) {
+            if (collectStats) {
+                start = chrono::steady_clock::now();
+            }
+        }
+        ~PhaseTimer() {
+            if (collectStats) {
+                localStats.phaseNanos[phase] += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+                localStats.phaseCalls[phase]++;
+            }
+        }
+};
+
+// Finds and returns the node corresponding to an operation
+Node* findNode(const string& opName) {
+    auto it = query.tree.nodeIds.find(opName);
+    return (it != query.tree.nodeIds.end()) ? &(query.tree.nodes[it->second]) : nullptr;
+}
+
+// Check if a given operation exists
+bool opExists(const string& opName) {
+    return query.operationIds.find(opName) != query.operationIds.end();
+}
+
+// Finds and returns an operation
+Operation* findOperation(const string& opName) {
+    auto it = query.operationIds.find(opName);
+    return (it != query.operationIds.end()) ? &(query.operations[it->second]) : NULL;
+}
+
+// Finds and returns an RF
+RF* findRF(Table* tbl, const string& colName) {
+    localStats.counters[COUNT_LOOKUPS]++;
+    auto it = tbl->rfSlots.find(lookupColumn(colName));
+    return (it != tbl->rfSlots.end()) ? &(tbl->rfs[it->second]) : nullptr;
+}
+
+// Finds and returns the histogram and MCV statistics of a column
+ColumnStats* findColumnStats(Table* tbl, const string& colName) {
+    localStats.counters[COUNT_LOOKUPS]++;
+    auto it = tbl->statSlots.find(lookupColumn(colName));
+    return (it != tbl->statSlots.end()) ? &(tbl->colStats[it->second]) : nullptr;
+}
+
+// Finds and returns the width statistics of a column
+ColumnWidth* findWidth(Table* tbl, const string& colName) {
+    localStats.counters[COUNT_LOOKUPS]++;
+    auto it = tbl->widthSlots.find(lookupColumn(colName));
+    return (it != tbl->widthSlots.end()) ? &(tbl->widths[it->second]) : nullptr;
+}
+
+// Finds and returns an index
+Index* findIndex(Table* tbl, const string& idxName) {
+    localStats.counters[COUNT_LOOKUPS]++;
+    auto it = tbl->idxSlots.find(lookupColumn(idxName));
+    return (it != tbl->idxSlots.end()) ? &(tbl->idxs[it->second]) : nullptr;
+}
+
+// Finds and returns a table, looking at the query's operation tables first
+Table* findTable(const string& tableName) {
+    localStats.counters[COUNT_LOOKUPS]++;
+    Table* tbl = query.opTables.findTable(tableName);
+    return (tbl != nullptr) ? tbl : catalog.findTable(tableName);
+}
+
+// Checks whether a node still reads the base table its access path was chosen for
+bool readsBaseTable(Node* node) {
+    return node->op->access.method != ACCESS_NONE && node->left != NULL &&
+           node->left->op->opType == "" && node->left->op->name == node->op->tbl1;
+}
+
+// Returns the active semi-join reduction of a base table's scan, or nullptr if there is none
+SemiJoin* activeSemiJoin(const string& tableName) {
+    for (unsigned int i = 0; i < query.semiJoins.size(); i++) {
+        if (query.semiJoins[i].active && query.semiJoins[i].table == tableName) {
+            return &(query.semiJoins[i]);
+        }
+    }
+    return nullptr;
+}
+
+// Returns the name of a node along with its join algorithm or its access path, if it reads a base table
+string nodeLabel(Node* node) {
+    if (node->op->opType == "JOIN" && node->op->joinMethod != JOIN_NONE) {
+        return node->op->name + " [" + joinMethodNames[node->op->joinMethod] + "]";
+    }
+    if (readsBaseTable(node)) {
+        return node->op->name + " [" + accessPathName(node->op->access) + "]";
+    }
+    SemiJoin* sj = (node->op->opType == "") ? activeSemiJoin(node->op->name) : nullptr;
+    if (sj != nullptr) {
+        return node->op->name + " [semi-join reduced by " + sj->keyTable + "]";
+    }
+    return node->op->name;
+}
+
+// Prints the child nodes of a node in the tree
+void printChildren(Node* root, string link, ostream& out) {
+    if (root == NULL) {
+        return;
+    }
+
+    bool leftExists = (root->left != NULL);
+    bool rightExists = (root->right != NULL);
+
+    // Has no children
+    if (!leftExists && !rightExists) {
+        return;
+    }
+
+    out << link;
+    out << ((leftExists && rightExists) ? "├── " : "");
+    out << ((!leftExists && rightExists) ? "└── " : "");
+
+    if (rightExists) {
+        bool grandChildExists = (leftExists && rightExists && (root->right->right != NULL || root->right->left != NULL));
+        string nextLink = link + (grandChildExists ? "|   " : "    ");
+        out << nodeLabel(root->right) << endl;
+        printChildren(root->right, nextLink, out);
+    }
+
+    if (leftExists) {
+        out << (rightExists ? link : "") << "└── " << nodeLabel(root->left) << endl;
+        printChildren(root->left, link + "    ", out);
+    }
+}
+
+// Function for printing the query tree
+void printTree(Node* root, ostream& out) {
+    // Base case
+    if (root == NULL) {
+        return;
+    }
+    out << nodeLabel(root) << endl;
+    printChildren(root, "", out);
+    out << endl;
+}
+
+// Finds out whether a node is the left/right child of a join operation in the tree
+string whichChild(Node* parent, Node* child) {
+    if (parent->left->op->name == child->op->name) {
+        return "left";
+    } else {
+        return "right";
+    }
+}
+
+// Moves selections/projections up the query tree to help build pipelined approach
+void updateUnary(Node* node) {
+    localStats.counters[COUNT_REWRITES]++;
+    // Make sure we're not at the root
+    Node* grandParentNode = node->parent->parent;
+    if (grandParentNode != NULL) {
+        if (grandParentNode->op->opType == "JOIN") {
+            if (whichChild(grandParentNode, node->parent) == "left") {
+                grandParentNode->left = node;
+                if (whichChild(node->parent, node) == "left") {
+                    node->parent->left = node->left;
+                } else {
+                    node->parent->right = node->left;
+                }
+                node->left->parent = node->parent;
+                node->parent->parent = node;
+                node->parent = grandParentNode;
+            } else {
+                grandParentNode->right = node;
+                if (whichChild(node->parent, node) == "left") {
+                    node->parent->left = node->left;
+                } else {
+                    node->parent->right = node->left;
+                }
+                node->left->parent = node->parent;
+                node->parent->parent = node;
+                node->parent = grandParentNode;
+            }
+        } else {
+            Node * tmp = node->parent;
+            grandParentNode->left = node;
+            if (whichChild(node->parent, node) == "left") {
+                node->parent->left = node->left;
+            } else {
+                node->parent->right = node->left;
+            }
+            node->left->parent = node->parent;
+            node->parent->parent = node;
+            node->parent = grandParentNode;
+            node->left = tmp;
+        }
+    } else {
+        node->parent->parent = node;
+        if (whichChild(node->parent, node) == "left") {
+            node->parent->left = node->left;
+        } else {
+            node->parent->right = node->left;
+        }
+        node->left->parent = node->parent;
+        node->left = node->parent;
+        node->parent = NULL;
+        query.tree.root = node;        
+    }
+}
+
+// Splits a comma separated list of columns
+vector<string> splitColumns(const string& list) {
+    vector<string> cols;
+    stringstream ss(list);
+    string col;
+    while (getline(ss, col, ',')) {
+        cols.push_back(col);
+    }
+    return cols;
+}
+
+// Checks if a column exists in a given table
+bool colExists(Table* tbl, const string& column) {
+    return tbl->colSlots.find(lookupColumn(column)) != tbl->colSlots.end();
+}
+
+// Re-structures the tree to make it left-deep
+void updateJoin(Node* node) {
+    // Base case is when the right side is a base table
+    if (node->right->op->opType == "") {
+        return;
+    }
+    localStats.counters[COUNT_REWRITES]++;
+    string joinCol = node->op->join_col2;
+    Table* rightTable = findTable(node->right->op->name);
+    if (colExists(rightTable, joinCol)) {
+        Node* tmp = node->parent;
+        node->parent = node->right;
+        node->right = node->right->right;
+        node->right->parent = node;
+        node->parent->right = node->parent->left;
+        node->parent->left = node;
+        if (tmp != NULL) {
+            tmp->left = node->parent;
+        } else {
+            query.tree.root = node->parent; 
+        }
+        node->parent->parent = tmp;
+    } else {
+        Node* tmp = node->parent;
+        node->parent = node->right;
+        node->right = node->right->left;
+        node->right->parent = node;
+        node->parent->left = node;
+        if (tmp != NULL) {
+            tmp->left = node->parent;       
+        } else {
+            query.tree.root = node->parent; 
+        }
+        node->parent->parent = tmp;
+    }
+    if (node->right->op->opType != "") {
+        updateJoin(node);
+    }
+}
+
+// Bytes in a page, which turn the page counts of the catalog into tuple widths and back
+const double PAGE_BYTES = 4096;
+
+// Returns the position of a column in a size estimate, or -1 if the estimate does not hold it
+int estimateColumn(const SizeEstimate& est, const string& col) {
+    for (unsigned int i = 0; i < est.columns.size(); i++) {
+        if (est.columns[i] == col) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Estimates the distinct values of a base table column from its index key count, its primary key or its RF
+// A column without statistics is taken to be a key
+double baseDistinct(Table* tbl, const string& col) {
+    Index* idx = findIndex(tbl, col);
+    if (idx != nullptr && idx->nkeys > 0) {
+        return min((double)idx->nkeys, max(1.0, (double)tbl->ntuples));
+    }
+    if (tbl->pks.size() == 1 && tbl->pks[0] == col) {
+        return max(1.0, (double)tbl->ntuples);
+    }
+    RF* rf = findRF(tbl, col);
+    if (rf != nullptr && rf->rfVal > 0) {
+        return min(1/rf->rfVal, max(1.0, (double)tbl->ntuples));
+    }
+    return max(1.0, (double)tbl->ntuples);
+}
+
+// Builds the size estimate of a base table
+// Columns with WIDTH statistics take their declared width and the others split what is left of the tuple
+// width the table's pages give evenly
+SizeEstimate baseSize(Table* tbl) {
+    SizeEstimate est;
+    est.ntuples = tbl->ntuples;
+    est.npages = tbl->npages;
+    double tupleWidth = (tbl->ntuples > 0 && tbl->npages > 0) ? tbl->npages*PAGE_BYTES/tbl->ntuples : PAGE_BYTES;
+    double declared = 0;
+    int undeclared = 0;
+    for (unsigned int i = 0; i < tbl->columns.size(); i++) {
+        ColumnWidth* width = findWidth(tbl, tbl->columns[i]);
+        if (width != nullptr) {
+            declared += width->bytes;
+        } else {
+            undeclared++;
+        }
+    }
+    double rest = (undeclared > 0) ? max(0.0, tupleWidth - declared)/undeclared : 0;
+    for (unsigned int i = 0; i < tbl->columns.size(); i++) {
+        ColumnWidth* width = findWidth(tbl, tbl->columns[i]);
+        est.columns.push_back(tbl->columns[i]);
+        est.colWidths.push_back((width != nullptr) ? width->bytes : rest);
+        est.distinct.push_back(baseDistinct(tbl, tbl->columns[i]));
+        est.width += est.colWidths.back();
+    }
+    if (tbl->columns.empty()) {
+        est.width = tupleWidth;
+    }
+    return est;
+}
+
+// Returns the size estimate of a base table or of an operation estimated earlier, or nullptr if there is none
+// Base table estimates are made once per query and shared by every plan that reads the table
+const SizeEstimate* sizeOf(const string& name) {
+    auto it = query.sizes.find(name);
+    if (it != query.sizes.end()) {
+        return &(it->second);
+    }
+    Table* tbl = catalog.findTable(name);
+    if (tbl == nullptr || opExists(name)) {
+        return nullptr;
+    }
+    return &(query.sizes[name] = baseSize(tbl));
+}
+
+// Returns the distinct values of a column of an estimated input, at most one per tuple
+double distinctValues(const SizeEstimate& est, const string& col) {
+    int i = estimateColumn(est, col);
+    double distinct = (i != -1) ? est.distinct[i] : est.ntuples;
+    return max(1.0, min(distinct, est.ntuples));
+}
+
+// Checks whether a column of one base table is a foreign key referencing a column of another
+bool referencesKey(Table* fkTbl, const string& fkCol, Table* keyTbl, const string& keyCol) {
+    for (unsigned int i = 0; i < fkTbl->fks.size(); i++) {
+        if (fkTbl->fks[i].col == fkCol && fkTbl->fks[i].ref_table == keyTbl->name && fkTbl->fks[i].ref_col == keyCol) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns the fraction of the cross product of two estimated inputs an equi-join keeps
+// A foreign key joined to the key it references finds exactly one match in the full key table, so the
+// join keeps |left||right|/|key table| whatever was filtered out of either side. Other joins assume the
+// side with fewer distinct values finds a match for each of them
+double joinSelectivity(const SizeEstimate& left, const string& col1, const SizeEstimate& right, const string& col2) {
+    Table* tbl1 = catalog.columnTable(col1);
+    Table* tbl2 = catalog.columnTable(col2);
+    if (tbl1 != nullptr && tbl2 != nullptr) {
+        if (tbl2->ntuples > 0 && referencesKey(tbl1, col1, tbl2, col2)) {
+            return 1.0/tbl2->ntuples;
+        }
+        if (tbl1->ntuples > 0 && referencesKey(tbl2, col2, tbl1, col1)) {
+            return 1.0/tbl1->ntuples;
+        }
+    }
+    return 1/max(distinctValues(left, col1), distinctValues(right, col2));
+}
+
+// Estimates the output of joining two estimated inputs on an equality predicate
+SizeEstimate joinSize(const SizeEstimate& left, const string& col1, const SizeEstimate& right, const string& col2) {
+    SizeEstimate est;
+    est.ntuples = left.ntuples*right.ntuples*joinSelectivity(left, col1, right, col2);
+    est.width = left.width + right.width;
+    est.npages = est.ntuples*est.width/PAGE_BYTES;
+    // Both join columns keep only the values present on both sides
+    double joined = min(distinctValues(left, col1), distinctValues(right, col2));
+    const SizeEstimate* inputs[2] = {&left, &right};
+    for (unsigned int s = 0; s < 2; s++) {
+        for (unsigned int i = 0; i < inputs[s]->columns.size(); i++) {
+            const string& col = inputs[s]->columns[i];
+            est.columns.push_back(col);
+            est.colWidths.push_back(inputs[s]->colWidths[i]);
+            est.distinct.push_back((col == col1 || col == col2) ? joined : min(inputs[s]->distinct[i], max(1.0, est.ntuples)));
+        }
+    }
+    return est;
+}
+
+// Largest join blocks handed to the dynamic programming enumerator, larger ones are ordered greedily
+// The memo holds every subset of the block, so a star that keeps all its dimensions doubles its time and
+// memory with each table; these limits keep the worst case near 50 ms
+const int MAX_DP_TABLES = 14;
+const int MAX_BUSHY_DP_TABLES = 13;
+
+// Enumerate bushy join trees instead of left-deep ones (--bushy)
+bool bushyJoins = false;
+
+// For storing a candidate plan in the join enumerator's memo table
+struct JoinPlan {
+    double cost = 0;
+    double ntuples = 0;
+    double npages = 0;
+    double tuplesPerPage = 1;
+    unsigned int leftSet = 0;
+    unsigned int rightSet = 0;
+    // Column ID the output is sorted on, or -1
+    int order = -1;
+    JoinMethod method = JOIN_NONE;
+    // Positions of the input plans in the memo entries of leftSet and rightSet
+    int outerPlan = -1;
+    int innerPlan = -1;
+};
+
+// For storing a join predicate between two leaves of a join block
+struct JoinEdge {
+    int leftLeaf;
+    int rightLeaf;
+    string leftCol;
+    string rightCol;
+    double rf;
+    bool leftIdxExists = false;
+    bool rightIdxExists = false;
+    Node* joinNode;
+};
+
+// For storing a block of consecutive joins and its memo table
+class JoinBlock {
+    public:
+        vector<Node*> leaves;
+        vector<Node*> joinNodes;
+        vector<Node*> unaryNodes;
+        vector<JoinEdge> edges;
+        vector<unsigned int> neighbours;
+        vector<vector<JoinPlan>> memo;
+        // Estimated rows of every set of leaves, the same whichever order joins them
+        vector<double> rows;
+};
+
+// For storing what calcOpCosts worked out for one operation
+struct CachedCosting {
+    int sel_val = 0;
+    int sel_hi = 0;
+    vector<int> sel_list;
+    double cost = 0;
+    JoinMethod joinMethod = JOIN_NONE;
+    AccessPath access;
+    int ntuples = 0;
+    double npages = 0;
+    double tuplesPerPage = 0;
+    SizeEstimate size;
+};
+
+// For storing the memo tables of a join block, enumerated without and with cross products
+struct CachedMemo {
+    vector<string> leaves;
+    shared_ptr<const vector<vector<JoinPlan>>> memo;
+    shared_ptr<const vector<vector<JoinPlan>>> crossMemo;
+};
+
+// Parts of the previous plan for the same query shape, kept when the catalog changed since it was made
+// Operations and join subsets that no changed table feeds into are taken from it instead of being costed again
+class ReuseContext {
+    public:
+        // Tables the previous plan read -> their catalog versions at the time
+        unordered_map<string, long> versions;
+        vector<CachedCosting> previousCostings;
+        vector<CachedMemo> previousMemos;
+        // Operations whose costing was taken from the previous plan
+        vector<bool> opReused;
+        // Costings and memo tables of this optimization, in the order they were made
+        vector<CachedCosting> costings;
+        vector<CachedMemo> memos;
+};
+
+thread_local ReuseContext reuse;
+
+// Checks whether a base table changed since the previous plan for the query shape was made
+bool tableChanged(const string& tableName) {
+    auto it = reuse.versions.find(tableName);
+    Table* tbl = catalog.findTable(tableName);
+    return it == reuse.versions.end() || tbl == nullptr || tbl->version != it->second;
+}
+
+// Checks whether an input of an operation, either a base table or an earlier operation, has to be costed again
+bool inputChanged(const string& name) {
+    auto it = query.operationIds.find(name);
+    if (it != query.operationIds.end()) {
+        return it->second >= (int)reuse.opReused.size() || !reuse.opReused[it->second];
+    }
+    // Operations added by the rewrites only change with the input they read
+    Node* node = findNode(name);
+    if (node != nullptr && node->op->opType != "") {
+        return inputChanged(node->op->tbl1);
+    }
+    return tableChanged(name);
+}
+
+// Finds the base table below a node that owns a given column
+Table* findColumnTable(Node* node, string column) {
+    if (node == NULL) {
+        return nullptr;
+    }
+    if (node->op->opType == "") {
+        Table* tbl = findTable(node->op->name);
+        return colExists(tbl, column) ? tbl : nullptr;
+    }
+    Table* tbl = findColumnTable(node->left, column);
+    if (tbl == nullptr) {
+        tbl = findColumnTable(node->right, column);
+    }
+    return tbl;
+}
+
+// Counts the tables in a set of join block leaves
+int leafCount(unsigned int set) {
+    return __builtin_popcount(set);
+}
+
+// Checks whether a node is one of a chain of selections and projections right above a base table
+// Such a chain stays where pushDownSelections and pushDownProjections put it and joins the block as a single leaf
+bool filtersBaseTable(Node* node) {
+    while (node->op->opType == "SELECTION" || node->op->opType == "PROJECTION") {
+        node = node->left;
+    }
+    return node->op->opType == "";
+}
+
+// Checks whether a set of join block leaves is a single base table that has not been filtered
+bool baseLeaf(JoinBlock* block, unsigned int set) {
+    return leafCount(set) == 1 && block->leaves[__builtin_ctz(set)]->op->opType == "";
+}
+
+// Collects the leaves, joins and unary operations below the top join of a block
+// Leaves are numbered from left to right, so the leaves below each side of a join form a range of positions
+// and no set of leaves is built before the block is known to be small enough for bitmasks
+void collectJoinBlock(Node* node, JoinBlock* block) {
+    if (node->op->opType == "JOIN") {
+        block->joinNodes.push_back(node);
+        unsigned int first = block->leaves.size();
+        collectJoinBlock(node->left, block);
+        unsigned int middle = block->leaves.size();
+        collectJoinBlock(node->right, block);
+        JoinEdge edge;
+        edge.leftLeaf = -1;
+        edge.rightLeaf = -1;
+        edge.leftCol = node->op->join_col1;
+        edge.rightCol = node->op->join_col2;
+        edge.rf = 1;
+        edge.joinNode = node;
+        // Resolve each join column against the leaves on its own side of the join
+        for (unsigned int i = first; i < block->leaves.size(); i++) {
+            Node* leaf = block->leaves[i];
+            if (edge.leftLeaf == -1 && i < middle && findColumnTable(leaf, edge.leftCol) != nullptr) {
+                edge.leftLeaf = i;
+            }
+            if (edge.rightLeaf == -1 && i >= middle && findColumnTable(leaf, edge.rightCol) != nullptr) {
+                edge.rightLeaf = i;
+            }
+        }
+        if (edge.leftLeaf != -1 && edge.rightLeaf != -1) {
+            block->edges.push_back(edge);
+        }
+    } else if (node->op->opType == "SELECTION" && !filtersBaseTable(node)) {
+        // Other selections are lifted above the block so the joins can be pipelined
+        block->unaryNodes.push_back(node);
+        collectJoinBlock(node->left, block);
+    } else {
+        // Projections stay leaves, since lifting one of joins would drop columns the joins above it read
+        block->leaves.push_back(node);
+    }
+}
+
+// Works out the reduction factor of a join predicate between two base tables the same way calcOpCosts does
+double joinRF(Table* tbl1, string col1, Table* tbl2, string col2) {
+    return joinSelectivity(*sizeOf(tbl1->name), col1, *sizeOf(tbl2->name), col2);
+}
+
+// Returns the cost of an external merge sort of an input, up to handing the last merge to a join
+// A base table input has to be read first, a pipelined one arrives for free
+double sortCost(double pages, double tuples, bool isBase) {
+    double cost = isBase ? pages*costProfile.seqPage : 0;
+    cost += (tuples > 1) ? tuples*log2(tuples)*costProfile.sortTuple : 0;
+    double B = max(bufferPages, 3);
+    if (pages <= B) {
+        return cost;
+    }
+    // Pass 0 writes sorted runs of B pages, each merge pass combines B-1 runs
+    double runs = ceil(pages/B);
+    double mergePasses = max(1.0, ceil(log(runs)/log(B - 1)));
+    return cost + pages*(costProfile.writePage + costProfile.seqPage)*mergePasses;
+}
+
+// Costs joining an outer and inner input with one join algorithm
+// outerCol and innerCol are the column IDs of the join predicate, or -1 for a cross product
+JoinPlan costJoin(JoinMethod method, JoinPlan* outer, bool outerIsBase, JoinPlan* inner, bool innerIsBase, double rf, int outerCol, int innerCol) {
+    JoinPlan plan;
+    double B = max(bufferPages, 3);
+    double M = outer->npages;
+    double N = inner->npages;
+    // The outer side is pipelined, so only a base table outer has to be read
+    double readOuter = outerIsBase ? M*costProfile.seqPage : 0;
+    double readInner = innerIsBase ? N*costProfile.seqPage : 0;
+    double joinCost = 0;
+    int order = -1;
+    if (method == JOIN_INDEX_NESTED_LOOP) {
+        double costToMatch = costProfile.indexProbe;
+        joinCost = readOuter + outer->ntuples * costToMatch;
+        order = outer->order;
+    } else if (method == JOIN_NESTED_LOOP || method == JOIN_BLOCK_NESTED_LOOP) {
+        // Tuple-at-a-time scans the inner once per outer tuple, block nested loop once per B-2 outer pages
+        double scans = (method == JOIN_NESTED_LOOP) ? outer->ntuples : ceil(M/(B - 2));
+        joinCost = readOuter + scans * N * costProfile.seqPage + outer->ntuples * inner->ntuples * costProfile.cpuTuple;
+        // A composite inner has to be materialized to a temp before it can be rescanned
+        if (!innerIsBase) {
+            joinCost += N * costProfile.writePage;
+        }
+        order = (method == JOIN_NESTED_LOOP) ? outer->order : -1;
+    } else if (method == JOIN_SORT_MERGE) {
+        // Inputs already sorted on their join column skip the sort
+        joinCost += (outer->order == outerCol) ? readOuter : sortCost(M, outer->ntuples, outerIsBase);
+        joinCost += (inner->order == innerCol) ? readInner : sortCost(N, inner->ntuples, innerIsBase);
+        order = outerCol;
+    } else if (method == JOIN_HASH) {
+        joinCost = readOuter + readInner + (outer->ntuples + inner->ntuples) * costProfile.hashTuple;
+        double build = min(M, N);
+        if (build > B - 2) {
+            // Grace partitioning writes and rereads both inputs once per pass
+            double passes = max(1.0, ceil(log(build/(B - 2))/log(B - 1)));
+            double kept = 0;
+            if (passes == 1) {
+                // Hybrid hash keeps the first partition in the pages not used as output buffers
+                double partitions = ceil(build/(B - 2));
+                kept = max(0.0, B - partitions - 1)/build;
+            }
+            joinCost += (M + N)*(costProfile.writePage + costProfile.seqPage)*passes*(1 - kept);
+        } else if (N <= M) {
+            // An in-memory build of the inner side streams the outer through in order
+            order = outer->order;
+        }
+    }
+    plan.method = method;
+    plan.cost = outer->cost + inner->cost + joinCost;
+    plan.ntuples = outer->ntuples * inner->ntuples * rf;
+    plan.tuplesPerPage = 1/(1/outer->tuplesPerPage + 1/inner->tuplesPerPage);
+    plan.npages = plan.ntuples/plan.tuplesPerPage;
+    plan.order = order;
+    return plan;
+}
+
+// Checks whether a join algorithm can evaluate a join
+// Index nested loop needs an index on a base inner, sort-merge and hash join need an equi-join predicate
+bool joinApplicable(JoinMethod method, bool innerIsBase, bool innerIdxExists, bool equiJoin) {
+    if (method == JOIN_INDEX_NESTED_LOOP) {
+        return innerIsBase && innerIdxExists;
+    }
+    if (method == JOIN_SORT_MERGE || method == JOIN_HASH) {
+        return equiJoin;
+    }
+    return method != JOIN_NONE;
+}
+
+// Costs every applicable join algorithm and returns the cheapest plan
+JoinPlan cheapestJoin(JoinPlan* outer, bool outerIsBase, JoinPlan* inner, bool innerIsBase, bool innerIdxExists, double rf, int outerCol, int innerCol) {
+    JoinPlan best;
+    for (int m = JOIN_NESTED_LOOP; m <= JOIN_HASH; m++) {
+        JoinMethod method = (JoinMethod)m;
+        if (!joinApplicable(method, innerIsBase, innerIdxExists, outerCol != -1 && innerCol != -1)) {
+            continue;
+        }
+        JoinPlan plan = costJoin(method, outer, outerIsBase, inner, innerIsBase, rf, outerCol, innerCol);
+        if (best.method == JOIN_NONE || plan.cost < best.cost) {
+            best = plan;
+        }
+    }
+    return best;
+}
+
+// Builds the plan for reading a base table
+JoinPlan basePlan(Table* tbl) {
+    JoinPlan plan;
+    plan.cost = 0;
+    plan.ntuples = tbl->ntuples;
+    plan.npages = tbl->npages;
+    plan.tuplesPerPage = (tbl->tuplesPerPage > 0) ? tbl->tuplesPerPage : 1;
+    return plan;
+}
+
+// Returns the plan for reading a leaf of a join block: a base table, the selections and projections filtering
+// one, or a projection of joins
+// Filtered leaves are pipelined: the bottom operation reads the table and the rest filter on the fly. The
+// joins below a projection are ordered as a block of their own, so they cost the same for every order of
+// this block and only their output counts
+JoinPlan leafPlan(Node* leaf) {
+    if (leaf->op->opType == "" || !filtersBaseTable(leaf)) {
+        return basePlan(findTable(leaf->op->name));
+    }
+    JoinPlan plan = leafPlan(leaf->left);
+    if (readsBaseTable(leaf)) {
+        plan.cost += leaf->op->cost;
+    } else if (leaf->left->op->opType == "") {
+        plan.cost += plan.npages*costProfile.seqPage;
+    }
+    Table* output = findTable(leaf->op->name);
+    plan.tuplesPerPage = (output->tuplesPerPage > 0) ? output->tuplesPerPage : plan.tuplesPerPage;
+    plan.ntuples = output->ntuples;
+    plan.npages = plan.ntuples/plan.tuplesPerPage;
+    return plan;
+}
+
+// Keeps a plan in the memo if it is the cheapest for its set and output order
+void addPlan(JoinBlock* block, unsigned int set, JoinPlan plan) {
+    localStats.counters[COUNT_PLANS]++;
+    vector<JoinPlan>& plans = block->memo[set];
+    for (unsigned int i = 0; i < plans.size(); i++) {
+        if (plans[i].order == plan.order) {
+            if (plan.cost < plans[i].cost) {
+                plans[i] = plan;
+            }
+            return;
+        }
+    }
+    plans.push_back(plan);
+}
+
+// Costs joining the plans of two disjoint sets of leaves with every applicable algorithm
+// and keeps the plans that are cheapest for their output order
+void joinPlans(JoinBlock* block, unsigned int set, unsigned int outerSet, int outerIdx, unsigned int innerSet, int innerIdx) {
+    bool innerIdxExists = false;
+    int outerCol = -1;
+    int innerCol = -1;
+    for (unsigned int i = 0; i < block->edges.size(); i++) {
+        JoinEdge* edge = &(block->edges[i]);
+        unsigned int leftBit = 1u << edge->leftLeaf;
+        unsigned int rightBit = 1u << edge->rightLeaf;
+        bool innerIdx;
+        int edgeOuterCol;
+        int edgeInnerCol;
+        if ((outerSet & leftBit) && (innerSet & rightBit)) {
+            innerIdx = edge->rightIdxExists;
+            edgeOuterCol = lookupColumn(edge->leftCol);
+            edgeInnerCol = lookupColumn(edge->rightCol);
+        } else if ((outerSet & rightBit) && (innerSet & leftBit)) {
+            innerIdx = edge->leftIdxExists;
+            edgeOuterCol = lookupColumn(edge->rightCol);
+            edgeInnerCol = lookupColumn(edge->leftCol);
+        } else {
+            continue;
+        }
+        // An index on the inner join column only helps when the inner side is a base table
+        if (innerIdx && baseLeaf(block, innerSet)) {
+            innerIdxExists = true;
+        }
+        // Sort-merge and hash join use the first predicate between the two sides
+        if (outerCol == -1) {
+            outerCol = edgeOuterCol;
+            innerCol = edgeInnerCol;
+        }
+    }
+    JoinPlan* outer = &(block->memo[outerSet][outerIdx]);
+    JoinPlan* inner = &(block->memo[innerSet][innerIdx]);
+    bool outerIsBase = baseLeaf(block, outerSet);
+    bool innerIsBase = baseLeaf(block, innerSet);
+    for (int m = JOIN_NESTED_LOOP; m <= JOIN_HASH; m++) {
+        JoinMethod method = (JoinMethod)m;
+        if (!joinApplicable(method, innerIsBase, innerIdxExists, outerCol != -1 && innerCol != -1)) {
+            continue;
+        }
+        JoinPlan plan = costJoin(method, outer, outerIsBase, inner, innerIsBase, 1, outerCol, innerCol);
+        plan.ntuples = block->rows[set];
+        plan.npages = plan.ntuples/plan.tuplesPerPage;
+        plan.leftSet = outerSet;
+        plan.rightSet = innerSet;
+        plan.outerPlan = outerIdx;
+        plan.innerPlan = innerIdx;
+        addPlan(block, set, plan);
+    }
+}
+
+// Returns the cheapest plan for a set of leaves regardless of order
+JoinPlan* bestPlan(JoinBlock* block, unsigned int set) {
+    JoinPlan* best = nullptr;
+    for (unsigned int i = 0; i < block->memo[set].size(); i++) {
+        if (best == nullptr || block->memo[set][i].cost < best->cost) {
+            best = &(block->memo[set][i]);
+        }
+    }
+    return best;
+}
+
+// Checks whether a later join predicate out of a set of leaves uses the column a plan is sorted on
+bool orderInteresting(JoinBlock* block, unsigned int set, int order) {
+    for (unsigned int i = 0; i < block->edges.size(); i++) {
+        JoinEdge* edge = &(block->edges[i]);
+        bool leftIn = (set & (1u << edge->leftLeaf)) != 0;
+        bool rightIn = (set & (1u << edge->rightLeaf)) != 0;
+        if (leftIn && !rightIn && lookupColumn(edge->leftCol) == order) {
+            return true;
+        }
+        if (rightIn && !leftIn && lookupColumn(edge->rightCol) == order) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Drops the plans of a finished set whose output order can no longer pay off: orders no later join
+// uses, and sorted plans that cost more than sorting the cheapest plan would
+void prunePlans(JoinBlock* block, unsigned int set) {
+    vector<JoinPlan>& plans = block->memo[set];
+    JoinPlan best = *bestPlan(block, set);
+    double sortedBest = best.cost + sortCost(best.npages, best.ntuples, false);
+    vector<JoinPlan> kept;
+    for (unsigned int i = 0; i < plans.size(); i++) {
+        JoinPlan plan = plans[i];
+        if (plan.order != -1 && !orderInteresting(block, set, plan.order)) {
+            plan.order = -1;
+        }
+        if (plan.order != -1 && plan.order != best.order && plan.cost >= sortedBest) {
+            continue;
+        }
+        bool replaced = false;
+        for (unsigned int j = 0; j < kept.size(); j++) {
+            if (kept[j].order == plan.order) {
+                if (plan.cost < kept[j].cost) {
+                    kept[j] = plan;
+                }
+                replaced = true;
+            }
+        }
+        if (!replaced) {
+            kept.push_back(plan);
+        }
+    }
+    plans = kept;
+}
+
+// Fills the memo table with the cheapest plans for every set of leaves
+// Sets made only of the leaves in unchanged take their plans from the memo table of a previous enumeration
+void enumerateJoins(JoinBlock* block, bool allowCross, const vector<vector<JoinPlan>>* previous, unsigned int unchanged) {
+    unsigned int n = block->leaves.size();
+    unsigned int full = (1u << n) - 1;
+    block->memo.assign(full + 1, vector<JoinPlan>());
+    block->rows.assign(full + 1, 0);
+    for (unsigned int i = 0; i < n; i++) {
+        block->memo[1u << i].push_back(leafPlan(block->leaves[i]));
+        block->rows[1u << i] = block->memo[1u << i][0].ntuples;
+    }
+    // Join sizes depend only on the set of leaves, so each is worked out once by adding its lowest leaf
+    // to the rest of the set
+    for (unsigned int set = 1; set <= full; set++) {
+        unsigned int lowBit = set & (~set + 1);
+        if (set == lowBit) {
+            continue;
+        }
+        double rf = 1;
+        for (unsigned int i = 0; i < block->edges.size(); i++) {
+            unsigned int leftBit = 1u << block->edges[i].leftLeaf;
+            unsigned int rightBit = 1u << block->edges[i].rightLeaf;
+            if ((leftBit == lowBit && (set & rightBit)) || (rightBit == lowBit && (set & leftBit))) {
+                rf *= block->edges[i].rf;
+            }
+        }
+        block->rows[set] = block->rows[set ^ lowBit]*block->rows[lowBit]*rf;
+    }
+    // Subsets always come before their supersets in numeric order
+    for (unsigned int set = 1; set <= full; set++) {
+        if (leafCount(set) < 2) {
+            continue;
+        }
+        if (previous != nullptr && (set & ~unchanged) == 0) {
+            block->memo[set] = (*previous)[set];
+            localStats.counters[COUNT_REUSED]++;
+            continue;
+        }
+        if (bushyJoins) {
+            for (unsigned int outerSet = (set - 1) & set; outerSet > 0; outerSet = (outerSet - 1) & set) {
+                unsigned int innerSet = set ^ outerSet;
+                if (block->memo[outerSet].empty() || block->memo[innerSet].empty()) {
+                    continue;
+                }
+                if (!allowCross && (block->neighbours[outerSet] & innerSet) == 0) {
+                    continue;
+                }
+                int inner = bestPlan(block, innerSet) - &(block->memo[innerSet][0]);
+                for (unsigned int i = 0; i < block->memo[outerSet].size(); i++) {
+                    joinPlans(block, set, outerSet, i, innerSet, inner);
+                }
+            }
+        } else {
+            for (unsigned int j = 0; j < n; j++) {
+                unsigned int innerSet = 1u << j;
+                unsigned int outerSet = set ^ innerSet;
+                if (!(set & innerSet) || block->memo[outerSet].empty()) {
+                    continue;
+                }
+                if (!allowCross && (block->neighbours[outerSet] & innerSet) == 0) {
+                    continue;
+                }
+                for (unsigned int i = 0; i < block->memo[outerSet].size(); i++) {
+                    joinPlans(block, set, outerSet, i, innerSet, 0);
+                }
+            }
+        }
+        if (!block->memo[set].empty()) {
+            prunePlans(block, set);
+        }
+    }
+}
+
+// Finds a join node of the block whose predicate connects two sets of leaves
+Node* takeJoinNode(JoinBlock* block, vector<bool>* used, unsigned int outerSet, unsigned int innerSet) {
+    for (unsigned int i = 0; i < block->edges.size(); i++) {
+        JoinEdge* edge = &(block->edges[i]);
+        unsigned int leftBit = 1u << edge->leftLeaf;
+        unsigned int rightBit = 1u << edge->rightLeaf;
+        bool forward = (outerSet & leftBit) && (innerSet & rightBit);
+        bool backward = (outerSet & rightBit) && (innerSet & leftBit);
+        if (!(forward || backward)) {
+            continue;
+        }
+        for (unsigned int j = 0; j < block->joinNodes.size(); j++) {
+            if (block->joinNodes[j] == edge->joinNode && !(*used)[j]) {
+                (*used)[j] = true;
+                // Orient the join columns so that join_col2 belongs to the inner table
+                if (backward) {
+                    Operation* op = edge->joinNode->op;
+                    swap(op->join_col1, op->join_col2);
+                    swap(edge->leftLeaf, edge->rightLeaf);
+                    swap(edge->leftCol, edge->rightCol);
+                    swap(edge->leftIdxExists, edge->rightIdxExists);
+                }
+                return edge->joinNode;
+            }
+        }
+    }
+    // Cross products take whichever join node is left over
+    for (unsigned int j = 0; j < block->joinNodes.size(); j++) {
+        if (!(*used)[j]) {
+            (*used)[j] = true;
+            return block->joinNodes[j];
+        }
+    }
+    return nullptr;
+}
+
+// Rebuilds the join tree for a set of leaves from the chosen plans in the memo
+Node* buildJoinTree(JoinBlock* block, vector<bool>* used, unsigned int set, JoinPlan* plan) {
+    if (leafCount(set) == 1) {
+        return block->leaves[__builtin_ctz(set)];
+    }
+    Node* joinNode = takeJoinNode(block, used, plan->leftSet, plan->rightSet);
+    joinNode->op->joinMethod = plan->method;
+    Node* leftNode = buildJoinTree(block, used, plan->leftSet, &(block->memo[plan->leftSet][plan->outerPlan]));
+    Node* rightNode = buildJoinTree(block, used, plan->rightSet, &(block->memo[plan->rightSet][plan->innerPlan]));
+    joinNode->left = leftNode;
+    joinNode->right = rightNode;
+    leftNode->parent = joinNode;
+    rightNode->parent = joinNode;
+    joinNode->op->tbl1 = leftNode->op->name;
+    joinNode->op->tbl2 = rightNode->op->name;
+    return joinNode;
+}
+
+// Fills the memo table of a block small enough for the enumerator and relinks its joins in the cheapest order
+// found, returning the top join
+Node* enumerateBlock(JoinBlock* block, unsigned int blockId) {
+    unsigned int n = block->leaves.size();
+    CachedMemo* cached = &(reuse.memos[blockId]);
+    for (unsigned int i = 0; i < n; i++) {
+        cached->leaves.push_back(block->leaves[i]->op->name);
+    }
+    // Subsets of leaves whose tables did not change keep the plans of the previous enumeration
+    const CachedMemo* previous = nullptr;
+    unsigned int unchanged = 0;
+    if (blockId < reuse.previousMemos.size() && reuse.previousMemos[blockId].leaves == cached->leaves) {
+        previous = &(reuse.previousMemos[blockId]);
+        for (unsigned int i = 0; i < n; i++) {
+            if (!inputChanged(cached->leaves[i])) {
+                unchanged |= 1u << i;
+            }
+        }
+    }
+
+    block->neighbours.assign(1u << n, 0);
+    for (unsigned int i = 0; i < block->edges.size(); i++) {
+        JoinEdge* edge = &(block->edges[i]);
+        block->neighbours[1u << edge->leftLeaf] |= 1u << edge->rightLeaf;
+        block->neighbours[1u << edge->rightLeaf] |= 1u << edge->leftLeaf;
+    }
+    for (unsigned int set = 1; set < (1u << n); set++) {
+        unsigned int lowBit = set & (~set + 1);
+        block->neighbours[set] = block->neighbours[lowBit] | block->neighbours[set ^ lowBit];
+    }
+
+    unsigned int full = (1u << n) - 1;
+    enumerateJoins(block, false, (previous != nullptr) ? previous->memo.get() : nullptr, unchanged);
+    if (block->memo[full].empty()) {
+        // The join graph is disconnected, so cross products cannot be avoided
+        cached->memo = make_shared<const vector<vector<JoinPlan>>>(move(block->memo));
+        enumerateJoins(block, true, (previous != nullptr) ? previous->crossMemo.get() : nullptr, unchanged);
+    }
+
+    vector<bool> used(block->joinNodes.size(), false);
+    Node* joinRoot = buildJoinTree(block, &used, full, bestPlan(block, full));
+    if (cached->memo == nullptr) {
+        cached->memo = make_shared<const vector<vector<JoinPlan>>>(move(block->memo));
+    } else {
+        cached->crossMemo = make_shared<const vector<vector<JoinPlan>>>(move(block->memo));
+    }
+    return joinRoot;
+}
+
+// For storing one join picked by the greedy orderer: the inputs it joins, the predicate it evaluates (-1 for a
+// cross product) and whether the predicate's left column is on the outer side
+struct GreedyStep {
+    int outer;
+    int inner;
+    int edge;
+    bool forward;
+    JoinMethod method;
+};
+
+// Estimates the joins of a block in the order they were written, with the cheapest algorithm for each
+// Selections the enumerator would lift are left out, the same way the greedy orderer leaves them out
+JoinPlan writtenPlan(JoinBlock* block, Node* node) {
+    if (node->op->opType == "SELECTION" && !filtersBaseTable(node)) {
+        return writtenPlan(block, node->left);
+    }
+    if (node->op->opType != "JOIN") {
+        return leafPlan(node);
+    }
+    JoinPlan outer = writtenPlan(block, node->left);
+    JoinPlan inner = writtenPlan(block, node->right);
+    bool outerIsBase = (node->left->op->opType == "");
+    bool innerIsBase = (node->right->op->opType == "");
+    for (unsigned int i = 0; i < block->edges.size(); i++) {
+        JoinEdge* edge = &(block->edges[i]);
+        if (edge->joinNode == node) {
+            return cheapestJoin(&outer, outerIsBase, &inner, innerIsBase, innerIsBase && edge->rightIdxExists, edge->rf,
+                                lookupColumn(edge->leftCol), lookupColumn(edge->rightCol));
+        }
+    }
+    return cheapestJoin(&outer, outerIsBase, &inner, innerIsBase, false, 1, -1, -1);
+}
+
+// Orders a block too large for the enumerator greedily (GOO): keeps joining the two inputs connected by a
+// join predicate whose join has the fewest output rows, on whichever side and with whichever algorithm is
+// cheapest. Inputs no predicate connects are crossed smallest first once every predicate is used
+// Returns the plan for the whole block and fills steps with the joins in the order they were picked
+JoinPlan greedyJoins(JoinBlock* block, vector<GreedyStep>* steps) {
+    unsigned int n = block->leaves.size();
+    // Every input is named after one of its leaves, and component maps each leaf to its input
+    vector<JoinPlan> plans;
+    vector<int> component;
+    vector<bool> single(n, true);
+    for (unsigned int i = 0; i < n; i++) {
+        plans.push_back(leafPlan(block->leaves[i]));
+        component.push_back(i);
+    }
+    vector<bool> usedEdge(block->edges.size(), false);
+    for (unsigned int step = 1; step < n; step++) {
+        int bestEdge = -1;
+        int a = -1;
+        int b = -1;
+        double bestRows = 0;
+        for (unsigned int i = 0; i < block->edges.size(); i++) {
+            JoinEdge* edge = &(block->edges[i]);
+            int left = component[edge->leftLeaf];
+            int right = component[edge->rightLeaf];
+            if (usedEdge[i] || left == right) {
+                continue;
+            }
+            double rows = plans[left].ntuples*plans[right].ntuples*edge->rf;
+            if (bestEdge == -1 || rows < bestRows) {
+                bestEdge = i;
+                a = left;
+                b = right;
+                bestRows = rows;
+            }
+        }
+        if (bestEdge == -1) {
+            for (unsigned int i = 0; i < n; i++) {
+                if (component[i] != (int)i) {
+                    continue;
+                }
+                if (a == -1 || plans[i].ntuples < plans[a].ntuples) {
+                    b = a;
+                    a = i;
+                } else if (b == -1 || plans[i].ntuples < plans[b].ntuples) {
+                    b = i;
+                }
+            }
+        }
+        GreedyStep best;
+        JoinPlan bestPlan;
+        for (int side = 0; side < 2; side++) {
+            GreedyStep candidate;
+            candidate.outer = (side == 0) ? a : b;
+            candidate.inner = (side == 0) ? b : a;
+            candidate.edge = bestEdge;
+            candidate.forward = true;
+            bool outerIsBase = single[candidate.outer] && block->leaves[candidate.outer]->op->opType == "";
+            bool innerIsBase = single[candidate.inner] && block->leaves[candidate.inner]->op->opType == "";
+            JoinPlan plan;
+            if (bestEdge != -1) {
+                JoinEdge* edge = &(block->edges[bestEdge]);
+                candidate.forward = (component[edge->leftLeaf] == candidate.outer);
+                int outerCol = lookupColumn(candidate.forward ? edge->leftCol : edge->rightCol);
+                int innerCol = lookupColumn(candidate.forward ? edge->rightCol : edge->leftCol);
+                bool innerIdx = innerIsBase && (candidate.forward ? edge->rightIdxExists : edge->leftIdxExists);
+                plan = cheapestJoin(&plans[candidate.outer], outerIsBase, &plans[candidate.inner], innerIsBase, innerIdx, edge->rf, outerCol, innerCol);
+            } else {
+                plan = cheapestJoin(&plans[candidate.outer], outerIsBase, &plans[candidate.inner], innerIsBase, false, 1, -1, -1);
+            }
+            if (side == 0 || plan.cost < bestPlan.cost) {
+                candidate.method = plan.method;
+                best = candidate;
+                bestPlan = plan;
+            }
+        }
+        if (bestEdge != -1) {
+            usedEdge[bestEdge] = true;
+        }
+        steps->push_back(best);
+        plans[best.outer] = bestPlan;
+        single[best.outer] = false;
+        for (unsigned int i = 0; i < n; i++) {
+            if (component[i] == best.inner) {
+                component[i] = best.outer;
+            }
+        }
+    }
+    return plans[component[0]];
+}
+
+// Relinks the joins of a block in the order the greedy orderer picked them and returns the top join
+// Cross products take the join nodes whose predicate matched no leaves, which are the ones left over
+Node* buildGreedyTree(JoinBlock* block, const vector<GreedyStep>& steps) {
+    vector<Node*> inputs = block->leaves;
+    vector<bool> used(block->joinNodes.size(), false);
+    for (unsigned int i = 0; i < block->edges.size(); i++) {
+        for (unsigned int j = 0; j < block->joinNodes.size(); j++) {
+            if (block->joinNodes[j] == block->edges[i].joinNode) {
+                used[j] = true;
+            }
+        }
+    }
+    Node* joinNode = NULL;
+    for (unsigned int s = 0; s < steps.size(); s++) {
+        const GreedyStep& step = steps[s];
+        if (step.edge != -1) {
+            joinNode = block->edges[step.edge].joinNode;
+            // Orient the join columns so that join_col2 belongs to the inner input
+            if (!step.forward) {
+                swap(joinNode->op->join_col1, joinNode->op->join_col2);
+            }
+        } else {
+            for (unsigned int j = 0; j < block->joinNodes.size(); j++) {
+                if (!used[j]) {
+                    used[j] = true;
+                    joinNode = block->joinNodes[j];
+                    break;
+                }
+            }
+        }
+        joinNode->op->joinMethod = step.method;
+        joinNode->left = inputs[step.outer];
+        joinNode->right = inputs[step.inner];
+        joinNode->left->parent = joinNode;
+        joinNode->right->parent = joinNode;
+        joinNode->op->tbl1 = joinNode->left->op->name;
+        joinNode->op->tbl2 = joinNode->right->op->name;
+        inputs[step.outer] = joinNode;
+    }
+    return joinNode;
+}
+
+// Picks the cheapest join order for the block of joins rooted at a node
+// Leaves that hold joins of their own are added to nested, so they can be ordered as blocks too
+// Blocks too large for the enumerator are ordered greedily, unless the order as written is estimated to be
+// no more expensive, in which case they are left as they are
+// Returns false if the block is irregular
+bool optimizeJoinBlock(Node* top, vector<Node*>* nested) {
+    JoinBlock block;
+    collectJoinBlock(top, &block);
+    // Blocks are met in the same order for every query of a shape, so the position identifies the block
+    unsigned int blockId = reuse.memos.size();
+    reuse.memos.push_back(CachedMemo());
+    unsigned int n = block.leaves.size();
+    int maxTables = bushyJoins ? MAX_BUSHY_DP_TABLES : MAX_DP_TABLES;
+    if (block.joinNodes.size() != n - 1) {
+        return false;
+    }
+    for (unsigned int i = 0; i < block.edges.size(); i++) {
+        JoinEdge* edge = &(block.edges[i]);
+        Table* tbl1 = findTable(block.leaves[edge->leftLeaf]->op->name);
+        Table* tbl2 = findTable(block.leaves[edge->rightLeaf]->op->name);
+        edge->rf = joinRF(tbl1, edge->leftCol, tbl2, edge->rightCol);
+        edge->leftIdxExists = (findIndex(tbl1, edge->leftCol) != nullptr);
+        edge->rightIdxExists = (findIndex(tbl2, edge->rightCol) != nullptr);
+    }
+    for (unsigned int i = 0; i < n; i++) {
+        if (!filtersBaseTable(block.leaves[i])) {
+            nested->push_back(block.leaves[i]);
+        }
+    }
+    // Remember where the block hangs off the rest of the tree before relinking
+    Node* parentNode = top->parent;
+    string side = (parentNode != NULL) ? whichChild(parentNode, top) : "";
+    Node* joinRoot = NULL;
+    if ((int)n > maxTables) {
+        vector<GreedyStep> steps;
+        if (greedyJoins(&block, &steps).cost >= writtenPlan(&block, top).cost) {
+            return true;
+        }
+        joinRoot = buildGreedyTree(&block, steps);
+    } else {
+        joinRoot = enumerateBlock(&block, blockId);
+    }
+
+    // Re-attach the lifted selections/projections above the reordered joins
+    Node* blockRoot = joinRoot;
+    for (int i = block.unaryNodes.size() - 1; i >= 0; i--) {
+        Node* unary = block.unaryNodes[i];
+        unary->left = blockRoot;
+        unary->right = NULL;
+        blockRoot->parent = unary;
+        blockRoot = unary;
+    }
+    blockRoot->parent = parentNode;
+    if (parentNode == NULL) {
+        query.tree.root = blockRoot;
+    } else if (side == "left") {
+        parentNode->left = blockRoot;
+    } else {
+        parentNode->right = blockRoot;
+    }
+    localStats.counters[COUNT_REWRITES]++;
+    return true;
+}
+
+// Wrapper function to restructure the original tree
+void recurseTree(Node* node) {
+    if (node->op->opType == "") {
+        return;
+    }
+    if (node->op->opType == "JOIN") {
+        // Enumerate join orders for the block, falling back to the left-deep rewrite
+        vector<Node*> nested;
+        if (optimizeJoinBlock(node, &nested)) {
+            for (unsigned int i = 0; i < nested.size(); i++) {
+                recurseTree(nested[i]);
+            }
+            return;
+        }
+        recurseTree(node->left);
+        recurseTree(node->right);
+        if (node->right->op->opType == "SELECTION" || node->right->op->opType == "PROJECTION") {
+            updateUnary(node->right);
+        } else if (node->left->op->opType == "SELECTION" || node->left->op->opType == "PROJECTION") {
+            updateUnary(node->left);
+        }
+        updateJoin(node);
+    } else {
+        recurseTree(node->left);
+    }
+}
+
+// Returns the cost of the original query
+double regularCost() {
+    double total = 0;
+    for (unsigned int i = 0; i < query.operations.size(); i++) {
+        if (query.operations[i].opType == "SELECTION" || query.operations[i].opType == "PROJECTION" || query.operations[i].opType == "JOIN") {
+            total += query.operations[i].cost;
+        }
+    }
+    return total;
+}
+
+// Checks whether a subtree reads a given base table
+bool containsTable(Node* node, const string& tableName) {
+    if (node == NULL) {
+        return false;
+    }
+    if (node->op->opType == "") {
+        return node->op->name == tableName;
+    }
+    return containsTable(node->left, tableName) || containsTable(node->right, tableName);
+}
+
+// Checks whether a node is the scan of a base table that a semi-join reduces
+bool reducedScan(Node* node) {
+    return node->op->opType == "" && activeSemiJoin(node->op->name) != nullptr;
+}
+
+// Applies the active semi-join reductions of a base table to the plan for scanning it
+// The scan still reads every page but passes on fewer rows, after the filtered table was scanned once
+// more to build the bloom filter of its keys, so its output is pipelined like that of a selection
+void reducePlan(Table* tbl, JoinPlan* plan) {
+    bool reduced = false;
+    for (unsigned int i = 0; i < query.semiJoins.size(); i++) {
+        SemiJoin* sj = &(query.semiJoins[i]);
+        if (!sj->active || sj->table != tbl->name) {
+            continue;
+        }
+        Table* keyTbl = findTable(sj->keyTable);
+        plan->ntuples *= sj->fraction;
+        plan->npages *= sj->fraction;
+        plan->cost += keyTbl->npages*costProfile.seqPage + (keyTbl->ntuples + tbl->ntuples)*costProfile.hashTuple;
+        reduced = true;
+    }
+    if (reduced) {
+        plan->cost += tbl->npages*costProfile.seqPage;
+    }
+}
+
+// Returns how much of a join's estimated output active semi-join reductions below it have already removed
+// A reduced scan joined to its key table would otherwise count the selections on the key table twice,
+// once in the scan and once in the filtered keys it is joined to
+double semiJoinOverlap(Node* node) {
+    double overlap = 1;
+    for (unsigned int i = 0; i < query.semiJoins.size(); i++) {
+        SemiJoin* sj = &(query.semiJoins[i]);
+        Node* keySide = NULL;
+        if (containsTable(node->left, sj->table) && containsTable(node->right, sj->keyTable)) {
+            keySide = node->right;
+        } else if (containsTable(node->right, sj->table) && containsTable(node->left, sj->keyTable)) {
+            keySide = node->left;
+        }
+        if (!sj->active || keySide == NULL) {
+            continue;
+        }
+        bool filtered = true;
+        for (unsigned int j = 0; j < sj->filters.size() && filtered; j++) {
+            Node* filter = findNode(sj->filters[j]->name);
+            while (filter != NULL && filter != keySide) {
+                filter = filter->parent;
+            }
+            filtered = (filter == keySide);
+        }
+        if (filtered) {
+            overlap *= sj->fraction;
+        }
+    }
+    return overlap;
+}
+
+// Estimates the output of a subtree of the optimized tree along with its cost
+JoinPlan subtreePlan(Node* node) {
+    JoinPlan plan;
+    if (node->op->opType == "") {
+        plan = basePlan(findTable(node->op->name));
+        reducePlan(findTable(node->op->name), &plan);
+    } else if (node->op->opType == "JOIN") {
+        JoinPlan outer = subtreePlan(node->left);
+        JoinPlan inner = subtreePlan(node->right);
+        Table* tbl1 = findColumnTable(node->left, node->op->join_col1);
+        Table* tbl2 = findColumnTable(node->right, node->op->join_col2);
+        double rf = 1;
+        if (tbl1 != nullptr && tbl2 != nullptr) {
+            rf = joinRF(tbl1, node->op->join_col1, tbl2, node->op->join_col2);
+        }
+        bool outerIsBase = (node->left->op->opType == "" && !reducedScan(node->left));
+        bool innerIsBase = (node->right->op->opType == "" && !reducedScan(node->right));
+        bool innerIdxExists = innerIsBase && findIndex(findTable(node->right->op->name), node->op->join_col2) != nullptr;
+        int outerCol = (tbl1 != nullptr && tbl2 != nullptr) ? lookupColumn(node->op->join_col1) : -1;
+        int innerCol = (tbl1 != nullptr && tbl2 != nullptr) ? lookupColumn(node->op->join_col2) : -1;
+        // Keep the algorithm the enumerator or a cached plan picked, otherwise take the cheapest
+        JoinMethod method = node->op->joinMethod;
+        if (joinApplicable(method, innerIsBase, innerIdxExists, outerCol != -1 && innerCol != -1)) {
+            plan = costJoin(method, &outer, outerIsBase, &inner, innerIsBase, rf, outerCol, innerCol);
+        } else {
+            plan = cheapestJoin(&outer, outerIsBase, &inner, innerIsBase, innerIdxExists, rf, outerCol, innerCol);
+            node->op->joinMethod = plan.method;
+        }
+        double overlap = semiJoinOverlap(node);
+        plan.ntuples /= overlap;
+        plan.npages /= overlap;
+    } else {
+        // Selections and projections are done on-the-fly unless they read a base table
+        plan = subtreePlan(node->left);
+        if (readsBaseTable(node) && !reducedScan(node->left)) {
+            plan.cost += node->op->cost;
+        } else if (node->left->op->opType == "" && !reducedScan(node->left)) {
+            plan.cost += plan.npages*costProfile.seqPage;
+        }
+        // Only the projected columns flow on, so the same rows fill fewer pages
+        Table* output = findTable(node->op->name);
+        if (node->op->opType == "PROJECTION" && output != nullptr && output->tuplesPerPage > 0) {
+            plan.tuplesPerPage = output->tuplesPerPage;
+            plan.npages = plan.ntuples/plan.tuplesPerPage;
+        }
+    }
+    // Remember the estimated output so execution can compare it with the real row count
+    node->op->ntuples = plan.ntuples;
+    if (node->op->opType == "SELECTION") {
+        Table* input = findTable(node->op->tbl1);
+        Table* output = findTable(node->op->name);
+        // A selection that reduced a scan below it through a semi-join has already been applied there
+        bool applied = false;
+        for (unsigned int i = 0; i < query.semiJoins.size(); i++) {
+            SemiJoin* sj = &(query.semiJoins[i]);
+            vector<Operation*>& filters = sj->filters;
+            if (sj->active && containsTable(node, sj->table) && find(filters.begin(), filters.end(), node->op) != filters.end()) {
+                applied = true;
+            }
+        }
+        if (input != nullptr && output != nullptr && input->ntuples > 0 && !applied) {
+            double fraction = (double)output->ntuples/input->ntuples;
+            node->op->ntuples *= fraction;
+            plan.ntuples *= fraction;
+            plan.npages *= fraction;
+        }
+    }
+    return plan;
+}
+
+// Returns the cost of the optimized query
+double optimizedCost() {
+    PhaseTimer timer(PHASE_OPT_COST);
+    return subtreePlan(query.tree.root).cost;
+}
+
+// Constructs the tree for the original query
+void constructTree(Node* node) {
+    if (node->op->opType == "JOIN") {
+        //Check if left, right tables of join operation are base tables
+        Node* leftNode = findNode(node->op->tbl1);
+        Node* rightNode = findNode(node->op->tbl2);
+        node->left = leftNode;
+        node->right = rightNode;
+        leftNode->parent = node;
+        rightNode->parent = node;
+    } else if (node->op->opType == "SELECTION" || node->op->opType == "PROJECTION") {
+        Node* leftNode = findNode(node->op->tbl1);
+        node->left = leftNode;
+        leftNode->parent = node;
+    }
+}
+
+// Adds the nodes for base tables
+void pushBaseNode(string tblName) {
+    Operation baseTblOp;
+    baseTblOp.name = tblName;
+    Node baseTblNode(query.tree.baseOps.add(baseTblOp));
+    query.tree.nodeIds[tblName] = query.tree.nodes.size();
+    query.tree.nodes.add(baseTblNode);
+    localStats.counters[COUNT_NODES]++;
+}
+
+// Adds the nodes for operations
+void pushOpNode(string opName) {
+    Operation* currOp = findOperation(opName);
+    Node opNode(currOp);
+    query.tree.nodeIds[opName] = query.tree.nodes.size();
+    query.tree.nodes.add(opNode);
+    localStats.counters[COUNT_NODES]++;
+}
+
+// Creates the nodes of the tree
+void createBaseTblNodes() {
+    // Only the base tables the query reads need a node
+    for (unsigned int i = 0; i < query.operations.size(); i++) {
+        string inputs[2] = {query.operations[i].tbl1, query.operations[i].tbl2};
+        for (unsigned int j = 0; j < 2; j++) {
+            if (inputs[j] != "" && findOperation(inputs[j]) == NULL && findNode(inputs[j]) == nullptr) {
+                pushBaseNode(inputs[j]);
+            }
+        }
+    }
+    for (unsigned int i = 0; i < query.operations.size(); i++) {
+        pushOpNode(query.operations[i].name);
+    } 
+}
+
+// Creates the query tree
+QueryTree* createQueryTree() {
+    PhaseTimer timer(PHASE_TREE);
+    createBaseTblNodes();
+    for (int i = 0; i < query.tree.nodes.size(); i++) {
+        constructTree(&(query.tree.nodes[i]));
+    }
+    query.tree.root = findNode("RESULT");
+    return &(query.tree);
+}
+
+// Checks whether an operation other than skip reads a column of a table
+bool columnsReferenced(Table* tbl, Operation* skip) {
+    for (unsigned int i = 0; i < query.operations.size(); i++) {
+        Operation* op = &(query.operations[i]);
+        vector<string> cols;
+        if (op == skip) {
+            continue;
+        } else if (op->opType == "SELECTION") {
+            cols.push_back(op->sel_col);
+        } else if (op->opType == "PROJECTION") {
+            cols = splitColumns(op->proj_cols);
+        } else if (op->opType == "JOIN") {
+            cols = {op->join_col1, op->join_col2};
+        }
+        for (unsigned int j = 0; j < cols.size(); j++) {
+            if (colExists(tbl, cols[j])) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Checks whether a projection above a node keeps the columns it produces out of the result
+bool projectedAbove(Node* node) {
+    for (Node* above = node->parent; above != NULL; above = above->parent) {
+        if (above->op->opType == "PROJECTION") {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Hangs a node where another one hangs below a parent, or at the root if there is no parent, and points the
+// parent operation at its new input
+void replaceChild(Node* parentNode, Node* old, Node* replacement) {
+    replacement->parent = parentNode;
+    if (parentNode == NULL) {
+        query.tree.root = replacement;
+        return;
+    }
+    if (parentNode->left == old) {
+        parentNode->left = replacement;
+    } else {
+        parentNode->right = replacement;
+    }
+    if (parentNode->op->tbl1 == old->op->name) {
+        parentNode->op->tbl1 = replacement->op->name;
+    }
+    if (parentNode->op->tbl2 == old->op->name) {
+        parentNode->op->tbl2 = replacement->op->name;
+    }
+}
+
+// Drops a join of a foreign key with the primary key it references when nothing else reads the key table
+// Every row of the foreign key side matches exactly one row of the key table, so the join neither adds nor
+// removes rows, and without any of its columns in use the key table contributes nothing
+bool eliminateJoin(Node* node) {
+    Operation* op = node->op;
+    Node* sides[2] = {node->right, node->left};
+    for (int s = 0; s < 2; s++) {
+        Node* keySide = sides[s];
+        Node* other = sides[1 - s];
+        if (keySide->op->opType != "" || !projectedAbove(node)) {
+            continue;
+        }
+        Table* keyTbl = findTable(keySide->op->name);
+        bool firstIsKey = colExists(keyTbl, op->join_col1);
+        string keyCol = firstIsKey ? op->join_col1 : op->join_col2;
+        string fkCol = firstIsKey ? op->join_col2 : op->join_col1;
+        Table* fkTbl = findColumnTable(other, fkCol);
+        if (fkTbl == nullptr || keyTbl->pks.size() != 1 || keyTbl->pks[0] != keyCol ||
+            !referencesKey(fkTbl, fkCol, keyTbl, keyCol) || columnsReferenced(keyTbl, op)) {
+            continue;
+        }
+        replaceChild(node->parent, node, other);
+        localStats.counters[COUNT_REWRITES]++;
+        return true;
+    }
+    return false;
+}
+
+// Collects the nodes of a subtree, children before their parents
+void collectNodes(Node* node, vector<Node*>* nodes) {
+    if (node == NULL) {
+        return;
+    }
+    collectNodes(node->left, nodes);
+    collectNodes(node->right, nodes);
+    nodes->push_back(node);
+}
+
+// Finds the selections on a table that can reduce the scan of another table joined to it
+// The query only joins and filters, so a row of the scanned table whose join value matches none of the
+// filtered keys can never reach the result, wherever the join and the selections end up in the tree
+void findSemiJoins(Node* root) {
+    vector<Node*> nodes;
+    collectNodes(root, &nodes);
+    for (unsigned int i = 0; i < nodes.size(); i++) {
+        Operation* op = nodes[i]->op;
+        if (op->opType != "JOIN") {
+            continue;
+        }
+        string cols[2] = {op->join_col1, op->join_col2};
+        for (int k = 0; k < 2; k++) {
+            SemiJoin sj;
+            Table* tbl = findColumnTable(nodes[i], cols[1 - k]);
+            Table* keyTbl = findColumnTable(nodes[i], cols[k]);
+            if (tbl == nullptr || keyTbl == nullptr || tbl == keyTbl) {
+                continue;
+            }
+            double filtered = keyTbl->ntuples;
+            for (unsigned int j = 0; j < nodes.size(); j++) {
+                Operation* sel = nodes[j]->op;
+                if (sel->opType == "SELECTION" && findColumnTable(nodes[j], sel->sel_col) == keyTbl) {
+                    Table* input = findTable(sel->tbl1);
+                    Table* output = findTable(sel->name);
+                    filtered *= (input->ntuples > 0) ? (double)output->ntuples/input->ntuples : 1;
+                    sj.filters.push_back(sel);
+                }
+            }
+            if (sj.filters.empty()) {
+                continue;
+            }
+            const SizeEstimate* scanned = sizeOf(tbl->name);
+            const SizeEstimate* keys = sizeOf(keyTbl->name);
+            double matched = min(filtered, distinctValues(*keys, cols[k]))*joinSelectivity(*scanned, cols[1 - k], *keys, cols[k]);
+            if (matched >= 1) {
+                continue;
+            }
+            sj.table = tbl->name;
+            sj.col = cols[1 - k];
+            sj.keyTable = keyTbl->name;
+            sj.keyCol = cols[k];
+            sj.fraction = matched;
+            query.semiJoins.push_back(sj);
+        }
+    }
+}
+
+// Rewrites the query tree before the joins are ordered: drops the joins foreign keys make redundant and
+// finds the selective filters whose keys can reduce the scans of the tables joined to them
+void reduceJoins(Node* root) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        vector<Node*> nodes;
+        collectNodes(root, &nodes);
+        for (unsigned int i = 0; i < nodes.size() && !changed; i++) {
+            if (nodes[i]->op->opType == "JOIN") {
+                changed = eliminateJoin(nodes[i]);
+            }
+        }
+    }
+    findSemiJoins(root);
+}
+
+// Turns on the semi-join reductions that make the optimized tree cheaper, one at a time, and returns its cost
+// A reduced scan can no longer be probed through its index, so a trial may change join algorithms, which
+// are put back when the reduction is turned down
+double chooseSemiJoins() {
+    double cost = optimizedCost();
+    vector<Node*> nodes;
+    collectNodes(query.tree.root, &nodes);
+    for (unsigned int i = 0; i < query.semiJoins.size(); i++) {
+        vector<JoinMethod> methods;
+        for (unsigned int j = 0; j < nodes.size(); j++) {
+            methods.push_back(nodes[j]->op->joinMethod);
+        }
+        query.semiJoins[i].active = true;
+        double reduced = optimizedCost();
+        if (reduced < cost) {
+            cost = reduced;
+        } else {
+            query.semiJoins[i].active = false;
+            for (unsigned int j = 0; j < nodes.size(); j++) {
+                nodes[j]->op->joinMethod = methods[j];
+            }
+        }
+    }
+    // Leave the estimates of the chosen plan on the nodes
+    return optimizedCost();
+}
+
+// Raised when a statement cannot be parsed, with the position of the problem
+class ParseError : public runtime_error {
+    public:
+        int line;
+        int col;
+        ParseError(string msg, int line, int col) : runtime_error(msg) {
+            this->line = line;
+            this->col = col;
+        }
+};
+
+// Kinds of token produced by the lexer
+enum TokenKind { TOKEN_WORD, TOKEN_NUMBER, TOKEN_SYMBOL, TOKEN_END };
+
+// For storing a token as a view into the input line
+struct Token {
+    TokenKind kind;
+    string_view text;
+    int col;
+};
+
+// Single-pass tokenizer over one line of input that never copies the line
+class Lexer {
+    public:
+        Lexer(string_view text, int line) {
+            this->text = text;
+            this->line = line;
+            advance();
+        }
+
+        Token peek() {
+            return current;
+        }
+        Token next() {
+            Token tok = current;
+            advance();
+            return tok;
+        }
+        bool atEnd() {
+            return current.kind == TOKEN_END;
+        }
+        bool isKeyword(const char* keyword) {
+            if (current.kind != TOKEN_WORD) {
+                return false;
+            }
+            size_t i = 0;
+            for (; keyword[i] != '\0'; i++) {
+                if (i >= current.text.size() || toupper((unsigned char)current.text[i]) != keyword[i]) {
+                    return false;
+                }
+            }
+            return i == current.text.size();
+        }
+        bool acceptKeyword(const char* keyword) {
+            if (isKeyword(keyword)) {
+                advance();
+                return true;
+            }
+            return false;
+        }
+        void expectKeyword(const char* keyword) {
+            if (!acceptKeyword(keyword)) {
+                fail(string("expected ") + keyword);
+            }
+        }
+        bool isSymbol(char c) {
+            return current.kind == TOKEN_SYMBOL && current.text[0] == c;
+        }
+        bool acceptSymbol(char c) {
+            if (isSymbol(c)) {
+                advance();
+                return true;
+            }
+            return false;
+        }
+        void expectSymbol(char c) {
+            if (!acceptSymbol(c)) {
+                fail(string("expected '") + c + "'");
+            }
+        }
+        string_view expectWord() {
+            if (current.kind != TOKEN_WORD) {
+                fail("expected a name");
+            }
+            return next().text;
+        }
+        // Whole numbers are stored in int fields, so larger ones are reported instead of wrapping
+        int expectInt() {
+            long value = 0;
+            string_view num = expectNumber();
+            auto res = from_chars(num.data(), num.data() + num.size(), value);
+            if (res.ec == errc::result_out_of_range || (res.ec == errc() && (value < INT_MIN || value > INT_MAX))) {
+                fail("number out of range", num);
+            }
+            if (res.ec != errc() || res.ptr != num.data() + num.size()) {
+                fail("expected a whole number", num);
+            }
+            return value;
+        }
+        double expectDouble() {
+            double value = 0;
+            string_view num = expectNumber();
+            // from_chars does not accept a leading '+'
+            const char* start = (num[0] == '+') ? num.data() + 1 : num.data();
+            auto res = from_chars(start, num.data() + num.size(), value);
+            if (res.ec != errc() || res.ptr != num.data() + num.size()) {
+                fail("expected a number", num);
+            }
+            return value;
+        }
+        [[noreturn]] void fail(string msg) {
+            string found = (current.kind == TOKEN_END) ? "end of line" : "'" + string(current.text) + "'";
+            throw ParseError(msg + " but found " + found, line, current.col);
+        }
+        [[noreturn]] void fail(string msg, string_view at) {
+            throw ParseError(msg + " but found '" + string(at) + "'", line, at.data() - text.data() + 1);
+        }
+
+    private:
+        string_view text;
+        size_t pos = 0;
+        int line;
+        Token current;
+
+        string_view expectNumber() {
+            if (current.kind != TOKEN_NUMBER) {
+                fail("expected a number");
+            }
+            return next().text;
+        }
+        void advance() {
+            while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\r')) {
+                pos++;
+            }
+            current.col = pos + 1;
+            if (pos >= text.size()) {
+                current.kind = TOKEN_END;
+                current.text = string_view();
+                return;
+            }
+            size_t start = pos;
+            char c = text[pos];
+            auto isDigit = [&](size_t i) { return i < text.size() && isdigit((unsigned char)text[i]); };
+            if (isalpha((unsigned char)c) || c == '_') {
+                while (pos < text.size() && (isalnum((unsigned char)text[pos]) || text[pos] == '_' || text[pos] == '.')) {
+                    pos++;
+                }
+                current.kind = TOKEN_WORD;
+            } else if (isDigit(pos) || ((c == '-' || c == '+' || c == '.') && (isDigit(pos + 1) || (c != '.' && text[pos + 1] == '.' && isDigit(pos + 2))))) {
+                pos++;
+                while (isDigit(pos) || (pos < text.size() && text[pos] == '.')) {
+                    pos++;
+                }
+                if (pos < text.size() && (text[pos] == 'e' || text[pos] == 'E')) {
+                    size_t exp = pos + 1;
+                    if (exp < text.size() && (text[exp] == '-' || text[exp] == '+')) {
+                        exp++;
+                    }
+                    if (isDigit(exp)) {
+                        pos = exp;
+                        while (isDigit(pos)) {
+                            pos++;
+                        }
+                    }
+                }
+                current.kind = TOKEN_NUMBER;
+            } else if (string_view("()=,;<>").find(c) != string_view::npos) {
+                pos++;
+                current.kind = TOKEN_SYMBOL;
+            } else {
+                throw ParseError(string("unexpected character '") + c + "'", line, pos + 1);
+            }
+            current.text = text.substr(start, pos - start);
+        }
+};
+
+// Kinds of statement in an input file
+enum StatementKind { STMT_NONE, STMT_TABLE, STMT_FOREIGN, STMT_CARDINALITY, STMT_SIZE, STMT_RF, STMT_HEIGHT, STMT_RANGE, STMT_HISTOGRAM, STMT_MCV, STMT_WIDTH, STMT_OP };
+
+// For storing a parsed statement until it is applied to the catalog or the query
+struct Statement {
+    StatementKind kind = STMT_NONE;
+    int line = 0;
+    int tableCol = 0;
+    // Column of the second input of a join
+    int table2Col = 0;
+    // Table the statement is about, and the column or index for index/column statistics
+    string table;
+    string column;
+    vector<string> columns;
+    vector<string> pks;
+    fk_relation fk;
+    double value = 0;
+    double value2 = 0;
+    // Histogram boundaries, or MCV values and their frequencies
+    vector<double> values;
+    vector<double> values2;
+    Operation op;
+    // Predicates ANDed to the first one of a selection, each parsed as a selection of its own
+    vector<Operation> conjuncts;
+};
+
+// Copies a name out of the input, upper-casing it as names are case-insensitive
+string upperName(string_view name) {
+    string upper(name);
+    for (unsigned int i = 0; i < upper.size(); i++) {
+        upper[i] = toupper((unsigned char)upper[i]);
+    }
+    return upper;
+}
+
+// Parses a bracketed, comma separated list of names such as (Dno,Salary)
+vector<string> parseNameList(Lexer& lex) {
+    vector<string> names;
+    lex.expectSymbol('(');
+    do {
+        names.push_back(upperName(lex.expectWord()));
+    } while (lex.acceptSymbol(','));
+    lex.expectSymbol(')');
+    return names;
+}
+
+// Joins names with commas, the way multi-attribute indexes and projections are named
+string joinNames(const vector<string>& names) {
+    string joined;
+    for (unsigned int i = 0; i < names.size(); i++) {
+        joined += (i > 0 ? "," : "") + names[i];
+    }
+    return joined;
+}
+
+// Parses the target of a statistics statement: (TABLE), (col IN TABLE) or ((a,b) IN TABLE)
+void parseStatTarget(Lexer& lex, Statement* stmt, bool allowTable) {
+    lex.expectSymbol('(');
+    if (lex.isSymbol('(')) {
+        stmt->column = joinNames(parseNameList(lex));
+        lex.expectKeyword("IN");
+    } else {
+        Token first = lex.peek();
+        string name = upperName(lex.expectWord());
+        if (lex.acceptKeyword("IN")) {
+            stmt->column = name;
+        } else if (allowTable) {
+            stmt->table = name;
+            stmt->tableCol = first.col;
+            lex.expectSymbol(')');
+            return;
+        } else {
+            lex.fail("expected IN");
+        }
+    }
+    stmt->tableCol = lex.peek().col;
+    stmt->table = upperName(lex.expectWord());
+    lex.expectSymbol(')');
+}
+
+// Accepts the second character of a two-character comparison, which has to follow the first without a gap
+bool acceptSecondSymbol(Lexer& lex, Token first, char c) {
+    if (lex.isSymbol(c) && lex.peek().col == first.col + 1) {
+        lex.next();
+        return true;
+    }
+    return false;
+}
+
+// Parses one predicate of a selection: col op value, col BETWEEN lo AND hi or col IN (v1, v2, ...)
+void parsePredicate(Lexer& lex, Operation* op) {
+    op->sel_col = upperName(lex.expectWord());
+    Token cmp = lex.peek();
+    if (lex.acceptSymbol('=')) {
+        op->sel_type = "=";
+    } else if (lex.acceptSymbol('<')) {
+        op->sel_type = acceptSecondSymbol(lex, cmp, '=') ? "<=" : acceptSecondSymbol(lex, cmp, '>') ? "<>" : "<";
+    } else if (lex.acceptSymbol('>')) {
+        op->sel_type = acceptSecondSymbol(lex, cmp, '=') ? ">=" : ">";
+    } else if (lex.acceptKeyword("BETWEEN")) {
+        op->sel_type = "BETWEEN";
+        op->sel_val = lex.expectInt();
+        lex.expectKeyword("AND");
+        op->sel_hi = lex.expectInt();
+        return;
+    } else if (lex.acceptKeyword("IN")) {
+        op->sel_type = "IN";
+        lex.expectSymbol('(');
+        do {
+            op->sel_list.push_back(lex.expectInt());
+        } while (lex.acceptSymbol(','));
+        lex.expectSymbol(')');
+        sort(op->sel_list.begin(), op->sel_list.end());
+        op->sel_list.erase(unique(op->sel_list.begin(), op->sel_list.end()), op->sel_list.end());
+        op->sel_val = op->sel_list[0];
+        return;
+    } else {
+        lex.fail("expected a comparison, BETWEEN or IN");
+    }
+    op->sel_val = lex.expectInt();
+}
+
+// Parses the right hand side of an operation statement
+void parseOperation(Lexer& lex, Statement* stmt) {
+    Operation* op = &(stmt->op);
+    stmt->tableCol = lex.peek().col;
+    op->tbl1 = upperName(lex.expectWord());
+    if (lex.acceptKeyword("SELECTION")) {
+        op->opType = "SELECTION";
+        parsePredicate(lex, op);
+        op->inherit_tbls.push_back(op->tbl1);
+        while (lex.acceptKeyword("AND")) {
+            Operation conjunct;
+            conjunct.opType = "SELECTION";
+            parsePredicate(lex, &conjunct);
+            stmt->conjuncts.push_back(conjunct);
+        }
+    } else if (lex.acceptKeyword("PROJECTION")) {
+        op->opType = "PROJECTION";
+        vector<string> cols;
+        do {
+            cols.push_back(upperName(lex.expectWord()));
+        } while (lex.acceptSymbol(','));
+        op->proj_cols = joinNames(cols);
+        op->inherit_tbls.push_back(op->tbl1);
+    } else if (lex.acceptKeyword("JOIN")) {
+        op->opType = "JOIN";
+        stmt->table2Col = lex.peek().col;
+        op->tbl2 = upperName(lex.expectWord());
+        lex.expectKeyword("ON");
+        op->join_col1 = upperName(lex.expectWord());
+        lex.expectSymbol('=');
+        op->join_col2 = upperName(lex.expectWord());
+        op->inherit_tbls.push_back(op->tbl1);
+        op->inherit_tbls.push_back(op->tbl2);
+    } else {
+        lex.fail("expected SELECTION, PROJECTION or JOIN");
+    }
+}
+
+// Parses one line of input into a statement, throwing a ParseError if it is malformed
+Statement parseStatement(string_view text, int lineNo) {
+    Lexer lex(text, lineNo);
+    Statement stmt;
+    stmt.line = lineNo;
+    if (lex.atEnd()) {
+        return stmt;
+    }
+    Token first = lex.peek();
+    if (first.kind != TOKEN_WORD) {
+        lex.fail("expected a statement");
+    }
+    lex.next();
+    if (lex.acceptSymbol('=')) {
+        // OPn = ... and RESULT = ...
+        stmt.kind = STMT_OP;
+        stmt.op.name = upperName(first.text);
+        parseOperation(lex, &stmt);
+    } else if (lex.isSymbol('(') || lex.peek().kind == TOKEN_WORD) {
+        Lexer keyword(first.text, lineNo);
+        if (keyword.isKeyword("TABLE")) {
+            stmt.kind = STMT_TABLE;
+            stmt.tableCol = lex.peek().col;
+            stmt.table = upperName(lex.expectWord());
+            lex.expectSymbol('(');
+            while (!lex.isKeyword("PRIMARY")) {
+                stmt.columns.push_back(upperName(lex.expectWord()));
+                if (!lex.acceptSymbol(',')) {
+                    break;
+                }
+            }
+            if (lex.acceptKeyword("PRIMARY")) {
+                lex.expectKeyword("KEY");
+                stmt.pks = parseNameList(lex);
+            }
+            lex.expectSymbol(')');
+        } else if (keyword.isKeyword("FOREIGN")) {
+            stmt.kind = STMT_FOREIGN;
+            lex.expectKeyword("KEY");
+            lex.expectSymbol('(');
+            stmt.tableCol = lex.peek().col;
+            stmt.table = upperName(lex.expectWord());
+            lex.expectSymbol('(');
+            stmt.fk.col = upperName(lex.expectWord());
+            lex.expectSymbol(')');
+            lex.expectKeyword("REFERENCES");
+            stmt.fk.ref_table = upperName(lex.expectWord());
+            lex.expectSymbol('(');
+            stmt.fk.ref_col = upperName(lex.expectWord());
+            lex.expectSymbol(')');
+            lex.expectSymbol(')');
+        } else if (keyword.isKeyword("CARDINALITY") || keyword.isKeyword("SIZE")) {
+            stmt.kind = keyword.isKeyword("SIZE") ? STMT_SIZE : STMT_CARDINALITY;
+            parseStatTarget(lex, &stmt, true);
+            lex.expectSymbol('=');
+            stmt.value = (stmt.kind == STMT_SIZE) ? lex.expectDouble() : lex.expectInt();
+        } else if (keyword.isKeyword("RF")) {
+            stmt.kind = STMT_RF;
+            parseStatTarget(lex, &stmt, false);
+            lex.expectSymbol('=');
+            stmt.value = lex.expectDouble();
+        } else if (keyword.isKeyword("WIDTH")) {
+            // WIDTH(col IN table) = average bytes a value of the column takes up in a tuple
+            stmt.kind = STMT_WIDTH;
+            parseStatTarget(lex, &stmt, false);
+            lex.expectSymbol('=');
+            Token width = lex.peek();
+            stmt.value = lex.expectDouble();
+            if (stmt.value <= 0) {
+                throw ParseError("column widths must be positive", lineNo, width.col);
+            }
+        } else if (keyword.isKeyword("HEIGHT")) {
+            stmt.kind = STMT_HEIGHT;
+            parseStatTarget(lex, &stmt, false);
+            lex.expectSymbol('=');
+            stmt.value = lex.expectInt();
+        } else if (keyword.isKeyword("RANGE")) {
+            stmt.kind = STMT_RANGE;
+            parseStatTarget(lex, &stmt, false);
+            lex.expectSymbol('=');
+            stmt.value = lex.expectInt();
+            lex.expectSymbol(',');
+            stmt.value2 = lex.expectInt();
+        } else if (keyword.isKeyword("HISTOGRAM")) {
+            // HISTOGRAM(col IN table) = b0, b1, ..., bk describes k buckets of equal depth
+            stmt.kind = STMT_HISTOGRAM;
+            parseStatTarget(lex, &stmt, false);
+            lex.expectSymbol('=');
+            do {
+                Token bound = lex.peek();
+                stmt.values.push_back(lex.expectDouble());
+                if (stmt.values.size() > 1 && stmt.values.back() < stmt.values[stmt.values.size() - 2]) {
+                    throw ParseError("histogram boundaries must be sorted", lineNo, bound.col);
+                }
+            } while (lex.acceptSymbol(','));
+            if (stmt.values.size() < 2) {
+                lex.fail("a histogram needs at least 2 boundaries");
+            }
+        } else if (keyword.isKeyword("MCV")) {
+            // MCV(col IN table) = (value, frequency), ...
+            stmt.kind = STMT_MCV;
+            parseStatTarget(lex, &stmt, false);
+            lex.expectSymbol('=');
+            double total = 0;
+            do {
+                lex.expectSymbol('(');
+                stmt.values.push_back(lex.expectDouble());
+                lex.expectSymbol(',');
+                Token freq = lex.peek();
+                stmt.values2.push_back(lex.expectDouble());
+                total += stmt.values2.back();
+                if (stmt.values2.back() < 0 || total > 1 + 1e-9) {
+                    throw ParseError("MCV frequencies must be fractions that sum to at most 1", lineNo, freq.col);
+                }
+                lex.expectSymbol(')');
+            } while (lex.acceptSymbol(','));
+        } else {
+            throw ParseError("unknown statement '" + string(first.text) + "'", lineNo, first.col);
+        }
+    } else {
+        lex.fail("expected '=' or '('");
+    }
+    lex.acceptSymbol(';');
+    if (!lex.atEnd()) {
+        lex.fail("expected end of statement");
+    }
+    return stmt;
+}
+
+// Copies indexes from one table to another
+void copyTableIdxs(Table* newTbl, Table* existingTbl) {
+    for (unsigned int i = 0; i < existingTbl->idxs.size(); i++) {
+        newTbl->addIndex(existingTbl->idxs[i]);
+    }
+}
+
+// Copies RFs from one table to another
+void copyTableRfs(Table* newTbl, Table* existingTbl) {
+    for (unsigned int i = 0; i < existingTbl->rfs.size(); i++) {
+        newTbl->addRF(existingTbl->rfs[i]);
+    }
+}
+
+// Copies PKs from one table to another
+void copyTablePks(Table* newTbl, Table* existingTbl) {
+    for (unsigned int i = 0; i < existingTbl->pks.size(); i++) {
+        newTbl->pks.push_back(existingTbl->pks[i]);
+    }
+}
+
+// Copies FKs from one table to another
+void copyTableFks(Table* newTbl, Table* existingTbl) {
+    for (unsigned int i = 0; i < existingTbl->fks.size(); i++) {
+        newTbl->fks.push_back(existingTbl->fks[i]);
+    }
+}   
+
+// Catalog version the tuples per page were last brought up to date with
+long regTblsVersion = -1;
+
+// Sets the tuples per page for each table changed since the last call
+void updateRegTbls() {
+    PhaseTimer timer(PHASE_REG_TABLES);
+    for (unsigned int i = 0; i < catalog.tables.size(); i++) {
+        if (catalog.tables[i].version <= regTblsVersion) {
+            continue;
+        }
+        if (catalog.tables[i].isOpTable == false && catalog.tables[i].npages > 0) {
+            catalog.tables[i].tuplesPerPage = catalog.tables[i].ntuples/catalog.tables[i].npages;
+        }
+    }
+    regTblsVersion = catalogVersion;
+}
+
+// Update the operation tables to preserve RFs, PKs, and FKs
+void updateOpTbls() {
+    PhaseTimer timer(PHASE_OP_TABLES);
+    for (unsigned int i = 0; i < query.operations.size(); i++) {
+        Table* opTable = findTable(query.operations[i].name);
+        for (unsigned int j = 0; j < query.operations[i].inherit_tbls.size(); j++) {
+            Table* toInherit = findTable(query.operations[i].inherit_tbls[j]);
+           // copyTableIdxs(opTable, toInherit);
+            copyTableRfs(opTable, toInherit);
+            copyTablePks(opTable, toInherit);
+            copyTableFks(opTable, toInherit);
+        }
+    }
+}
+
+// Returns the total frequency of a column's most common values
+double mcvTotal(const ColumnStats& stats) {
+    return stats.mcvCumFreqs.empty() ? 0 : stats.mcvCumFreqs.back();
+}
+
+// Returns the fraction of the histogram's tuples with a value <= v, interpolating inside a bucket
+double histogramFractionAtMost(const ColumnStats& stats, double v) {
+    if (v < stats.bounds.front()) {
+        return 0;
+    }
+    if (v >= stats.bounds.back()) {
+        return 1;
+    }
+    int i = upper_bound(stats.bounds.begin(), stats.bounds.end(), v) - stats.bounds.begin() - 1;
+    double width = stats.bounds[i + 1] - stats.bounds[i];
+    double within = (width > 0) ? (v - stats.bounds[i])/width : 1;
+    return stats.cumFreqs[i] + (stats.cumFreqs[i + 1] - stats.cumFreqs[i])*within;
+}
+
+// Estimates the fraction of a column equal to v, or -1 if the statistics cannot tell
+double estimateEquals(const ColumnStats& stats, double v) {
+    auto it = lower_bound(stats.mcvValues.begin(), stats.mcvValues.end(), v);
+    if (it != stats.mcvValues.end() && *it == v) {
+        int i = it - stats.mcvValues.begin();
+        return stats.mcvCumFreqs[i] - (i > 0 ? stats.mcvCumFreqs[i - 1] : 0);
+    }
+    if (stats.bounds.empty()) {
+        return -1;
+    }
+    if (v < stats.bounds.front() || v > stats.bounds.back()) {
+        return 0;
+    }
+    // Values are integers spread evenly over their bucket
+    int i = upper_bound(stats.bounds.begin(), stats.bounds.end(), v) - stats.bounds.begin() - 1;
+    i = min(i, (int)stats.bounds.size() - 2);
+    double distinct = max(1.0, stats.bounds[i + 1] - stats.bounds[i]);
+    return (1 - mcvTotal(stats))*(stats.cumFreqs[i + 1] - stats.cumFreqs[i])/distinct;
+}
+
+// Estimates the fraction of a column greater than v, or -1 if the statistics cannot tell
+double estimateGreater(const ColumnStats& stats, double v) {
+    if (stats.bounds.empty()) {
+        return -1;
+    }
+    int atMost = upper_bound(stats.mcvValues.begin(), stats.mcvValues.end(), v) - stats.mcvValues.begin();
+    double mcvAbove = mcvTotal(stats) - (atMost > 0 ? stats.mcvCumFreqs[atMost - 1] : 0);
+    return mcvAbove + (1 - mcvTotal(stats))*(1 - histogramFractionAtMost(stats, v));
+}
+
+// Works out the fraction of a column a selection matches from the fractions equal to a value and greater
+// than a value, or returns -1 if either cannot tell. Values are integers, so x >= v is x > v - 1
+template <typename Equals, typename Greater>
+double selectionFraction(Operation* sel, Equals equals, Greater greater) {
+    double v = sel->sel_val;
+    double fraction = -1;
+    if (sel->sel_type == "=") {
+        fraction = equals(v);
+    } else if (sel->sel_type == "<>") {
+        double eq = equals(v);
+        fraction = (eq >= 0) ? 1 - eq : -1;
+    } else if (sel->sel_type == ">" || sel->sel_type == ">=") {
+        fraction = greater((sel->sel_type == ">") ? v : v - 1);
+    } else if (sel->sel_type == "<" || sel->sel_type == "<=") {
+        double gt = greater((sel->sel_type == "<") ? v - 1 : v);
+        fraction = (gt >= 0) ? 1 - gt : -1;
+    } else if (sel->sel_type == "BETWEEN") {
+        double above = greater(v - 1);
+        double past = greater(sel->sel_hi);
+        fraction = (above >= 0 && past >= 0) ? above - past : -1;
+    } else if (sel->sel_type == "IN") {
+        fraction = 0;
+        for (unsigned int i = 0; i < sel->sel_list.size() && fraction >= 0; i++) {
+            double eq = equals(sel->sel_list[i]);
+            fraction = (eq >= 0) ? fraction + eq : -1;
+        }
+    }
+    return (fraction >= 0) ? min(1.0, max(0.0, fraction)) : -1;
+}
+
+// Scales a column's reduction factor, which describes an equality, to the comparison of a selection
+// Ranges only keep the factor as it is when the column has no index range or histogram to estimate them from
+double selectionRF(RF* rf, Operation* sel) {
+    double rfVal = (rf != nullptr && rf->rfVal >= 0) ? rf->rfVal : 1;
+    if (sel->sel_type == "<>") {
+        return 1 - rfVal;
+    }
+    if (sel->sel_type == "IN") {
+        return min(1.0, rfVal*sel->sel_list.size());
+    }
+    return rfVal;
+}
+
+// Estimates the fraction of a base table a selection matches from the column's histogram and MCVs,
+// or -1 if there are no usable statistics
+double columnStatsFraction(Table* tbl, Operation* sel) {
+    ColumnStats* stats = findColumnStats(tbl, sel->sel_col);
+    if (stats == nullptr) {
+        return -1;
+    }
+    return selectionFraction(sel, [&](double v) { return estimateEquals(*stats, v); },
+                             [&](double v) { return estimateGreater(*stats, v); });
+}
+
+// Returns the columns of a (possibly multi-attribute) index, e.g. "Dno,Salary"
+vector<string> indexColumns(const Index& idx) {
+    return splitColumns(idx.name);
+}
+
+// Tables are assumed to be stored in primary key order, so only an index led by the key is clustered
+bool clusteredIndex(Table* tbl, const Index& idx) {
+    return !tbl->pks.empty() && indexColumns(idx)[0] == tbl->pks[0];
+}
+
+// Returns the fraction of a table a selection matches through an index led by the selection column,
+// or -1 if the index has no usable statistics for the comparison
+// The key count of a multi-attribute index counts combinations, so it says nothing about "=" on one column
+double indexFraction(const Index& idx, Operation* sel) {
+    bool single = indexColumns(idx).size() == 1;
+    return selectionFraction(sel, [&](double v) { return (idx.nkeys > 0 && single) ? 1.0/idx.nkeys : -1; },
+                             [&](double v) { return (idx.max > idx.min) ? min(1.0, max(0.0, (idx.max - v)/(idx.max - idx.min))) : -1; });
+}
+
+// Returns the fraction of a base table a selection matches from the column's histogram or the range and
+// key count of an index led by the column, or -1 if there are no usable statistics
+double columnFraction(Table* tbl, Operation* sel) {
+    double fraction = columnStatsFraction(tbl, sel);
+    for (unsigned int i = 0; i < tbl->idxs.size() && fraction < 0; i++) {
+        if (indexColumns(tbl->idxs[i])[0] == sel->sel_col) {
+            fraction = indexFraction(tbl->idxs[i], sel);
+        }
+    }
+    return fraction;
+}
+
+// Returns the columns a projection reading an operation needs, or an empty list if the whole tuple is needed
+vector<string> projectedColumns(const string& opName) {
+    for (unsigned int i = 0; i < query.operations.size(); i++) {
+        if (query.operations[i].opType == "PROJECTION" && query.operations[i].tbl1 == opName) {
+            return splitColumns(query.operations[i].proj_cols);
+        }
+    }
+    return vector<string>();
+}
+
+// Checks whether an index holds every column in a list
+bool indexCovers(const Index& idx, const vector<string>& cols) {
+    if (cols.empty()) {
+        return false;
+    }
+    vector<string> idxCols = indexColumns(idx);
+    for (unsigned int i = 0; i < cols.size(); i++) {
+        if (find(idxCols.begin(), idxCols.end(), cols[i]) == idxCols.end()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Picks the cheapest way to read a base table for a selection (sel) or a projection (sel is NULL)
+// Compares a heap scan, a B+-tree probe (height + leaf pages + matching tuples) and index-only scans
+// over indexes that hold every needed column
+AccessPath chooseAccessPath(Table* tbl, Operation* sel, const vector<string>& neededCols) {
+    AccessPath best;
+    best.method = ACCESS_HEAP_SCAN;
+    best.cost = tbl->npages*costProfile.seqPage + tbl->ntuples*costProfile.cpuTuple;
+    best.fraction = -1;
+    double tuplesPerPage = (tbl->tuplesPerPage > 0) ? tbl->tuplesPerPage : 1;
+    // Histograms and MCVs describe skewed columns better than index key counts and ranges
+    double statsFraction = (sel != NULL) ? columnStatsFraction(tbl, sel) : -1;
+    if (statsFraction >= 0) {
+        best.fraction = statsFraction;
+    }
+    for (unsigned int i = 0; i < tbl->idxs.size(); i++) {
+        const Index& idx = tbl->idxs[i];
+        double traversal = (idx.height >= 0) ? idx.height : 1;
+        bool leading = (sel != NULL && indexColumns(idx)[0] == sel->sel_col);
+        double fraction = !leading ? -1 : (statsFraction >= 0) ? statsFraction : indexFraction(idx, sel);
+        if (fraction >= 0 && best.fraction < 0) {
+            best.fraction = fraction;
+        }
+        AccessPath path;
+        path.index = idx.name;
+        path.fraction = fraction;
+        if (leading && fraction < 0) {
+            // Fall back to the column's reduction factor, scaled to the comparison, to size the probe
+            RF* rf = findRF(tbl, sel->sel_col);
+            fraction = (rf != nullptr && rf->rfVal >= 0) ? selectionRF(rf, sel) : -1;
+        }
+        // A <> matches everything but one key, which a probe cannot skip more cheaply than a scan
+        if (fraction >= 0 && sel->sel_type != "<>") {
+            double matching = fraction*tbl->ntuples;
+            double leafPages = ceil(fraction*idx.npages);
+            path.method = ACCESS_INDEX_PROBE;
+            // Clustered indexes read the matching pages, unclustered ones fetch every matching tuple
+            double heapCost = clusteredIndex(tbl, idx) ? ceil(matching/tuplesPerPage)*costProfile.seqPage : matching*costProfile.randomPage;
+            path.cost = traversal*costProfile.randomPage + leafPages*costProfile.seqPage + heapCost + matching*costProfile.cpuTuple;
+            if (path.cost < best.cost) {
+                best = path;
+            }
+        }
+        // An empty list means the whole tuple is needed, so no index can cover it
+        vector<string> cols = neededCols;
+        if (sel != NULL && !cols.empty()) {
+            cols.push_back(sel->sel_col);
+        }
+        if (idx.npages > 0 && indexCovers(idx, cols)) {
+            // The heap is never touched; a leading selection column narrows the leaf range
+            path.method = ACCESS_INDEX_ONLY;
+            double leafCost = ((fraction >= 0) ? ceil(fraction*idx.npages) : idx.npages)*costProfile.seqPage;
+            path.cost = (fraction >= 0) ? traversal*costProfile.randomPage + leafCost : leafCost;
+            if (path.cost < best.cost) {
+                best = path;
+            }
+        }
+    }
+    return best;
+}
+
+// Remembers what calcOpCosts worked out for an operation so a later query of the same shape can reuse it
+void recordCosting(int opId) {
+    Operation* op = &(query.operations[opId]);
+    Table* opTable = findTable(op->name);
+    CachedCosting* costing = &(reuse.costings[opId]);
+    costing->sel_val = (op->opType == "SELECTION") ? op->sel_val : 0;
+    costing->sel_hi = op->sel_hi;
+    costing->sel_list = op->sel_list;
+    costing->cost = op->cost;
+    costing->joinMethod = op->joinMethod;
+    costing->access = op->access;
+    costing->ntuples = opTable->ntuples;
+    costing->npages = opTable->npages;
+    costing->tuplesPerPage = opTable->tuplesPerPage;
+    auto it = query.sizes.find(op->name);
+    if (it != query.sizes.end()) {
+        costing->size = it->second;
+    }
+}
+
+// Takes the costing of an operation from the previous plan for the query shape if none of its inputs changed
+// Returns false if the operation has to be costed again
+bool reuseCosting(int opId) {
+    Operation* op = &(query.operations[opId]);
+    if (opId >= (int)reuse.previousCostings.size() || inputChanged(op->tbl1) || (op->tbl2 != "" && inputChanged(op->tbl2))) {
+        return false;
+    }
+    const CachedCosting& costing = reuse.previousCostings[opId];
+    if (op->opType == "SELECTION" && (op->sel_val != costing.sel_val || op->sel_hi != costing.sel_hi || op->sel_list != costing.sel_list)) {
+        return false;
+    }
+    Table* opTable = findTable(op->name);
+    op->cost = costing.cost;
+    op->joinMethod = costing.joinMethod;
+    op->access = costing.access;
+    opTable->ntuples = costing.ntuples;
+    opTable->npages = costing.npages;
+    opTable->tuplesPerPage = costing.tuplesPerPage;
+    query.sizes[op->name] = costing.size;
+    reuse.costings[opId] = costing;
+    reuse.opReused[opId] = true;
+    return true;
+}
+
+// Costs a selection over its input and estimates how many rows it keeps
+void costSelection(Operation* op) {
+    Table* opTable = findTable(op->name);
+    Table* tbl1 = findTable(op->tbl1);
+    RF* selColRF = findRF(opTable, op->sel_col);
+    opTable->ntuples = tbl1->ntuples*selectionRF(selColRF, op);
+    op->access = AccessPath();
+    op->cost = tbl1->npages;
+    // Base tables pick the cheapest access path, which also refines the estimate from the column's
+    // histogram, index range or key count. Selections over operations take the fraction from the
+    // statistics of the base table that owns the column
+    double fraction = -1;
+    if (tbl1->isOpTable == false) {
+        op->access = chooseAccessPath(tbl1, op, projectedColumns(op->name));
+        op->cost = op->access.cost;
+        fraction = op->access.fraction;
+    } else if (catalog.columnTable(op->sel_col) != nullptr) {
+        fraction = columnFraction(catalog.columnTable(op->sel_col), op);
+    }
+    if (fraction >= 0) {
+        opTable->ntuples = tbl1->ntuples*fraction;
+    }
+    // If we are selecting from an existing operation, use on-the-fly
+    if (tbl1->isOpTable == true) {
+        op->cost = 0;
+    }
+}
+
+// Estimates the output of an operation from the estimates of its inputs and stores it in its table
+// Selections keep the row count calcOpCosts worked out from the column statistics and access path
+void estimateOperation(Operation* op) {
+    Table* opTable = findTable(op->name);
+    const SizeEstimate* left = sizeOf(op->tbl1);
+    if (left == nullptr) {
+        return;
+    }
+    SizeEstimate est;
+    if (op->opType == "JOIN") {
+        const SizeEstimate* right = sizeOf(op->tbl2);
+        if (right == nullptr) {
+            return;
+        }
+        est = joinSize(*left, op->join_col1, *right, op->join_col2);
+        // Row counts are stored as int, so huge intermediate results are capped
+        opTable->ntuples = min((double)INT_MAX, est.ntuples);
+    } else if (op->opType == "SELECTION") {
+        est = *left;
+        est.ntuples = opTable->ntuples;
+        double fraction = (left->ntuples > 0) ? est.ntuples/left->ntuples : 1;
+        for (unsigned int i = 0; i < est.columns.size(); i++) {
+            if (est.columns[i] == op->sel_col && op->sel_type == "=") {
+                est.distinct[i] = 1;
+            } else if (est.columns[i] == op->sel_col && op->sel_type == "IN") {
+                est.distinct[i] = min(est.distinct[i], (double)op->sel_list.size());
+            } else if (est.columns[i] == op->sel_col) {
+                est.distinct[i] = max(1.0, est.distinct[i]*fraction);
+            } else {
+                est.distinct[i] = max(1.0, min(est.distinct[i], est.ntuples));
+            }
+        }
+    } else if (op->opType == "PROJECTION") {
+        // Projections keep duplicates, so only the width shrinks
+        est.ntuples = left->ntuples;
+        est.width = 0;
+        vector<string> cols = splitColumns(op->proj_cols);
+        double defaultWidth = left->columns.empty() ? left->width : left->width/left->columns.size();
+        for (unsigned int i = 0; i < cols.size(); i++) {
+            int c = estimateColumn(*left, cols[i]);
+            est.columns.push_back(cols[i]);
+            est.colWidths.push_back((c != -1) ? left->colWidths[c] : defaultWidth);
+            est.distinct.push_back((c != -1) ? left->distinct[c] : left->ntuples);
+            est.width += est.colWidths.back();
+        }
+        opTable->ntuples = left->ntuples;
+    } else {
+        return;
+    }
+    est.npages = est.ntuples*est.width/PAGE_BYTES;
+    opTable->npages = est.npages;
+    opTable->tuplesPerPage = (est.width > 0) ? PAGE_BYTES/est.width : 1;
+    query.sizes[op->name] = est;
+}
+
+// Function for calculating cost of operations
+void calcOpCosts() {
+    PhaseTimer timer(PHASE_COSTING);
+    reuse.opReused.assign(query.operations.size(), false);
+    reuse.costings.assign(query.operations.size(), CachedCosting());
+    for (unsigned int i = 0; i < query.operations.size(); i++) {
+       // cout << "Currently on operation " << query.operations[i].name << endl;
+        Operation* op = &(query.operations[i]);
+        if (reuseCosting(i)) {
+            continue;
+        }
+        if (op->opType == "JOIN") {
+            // We assume that tbl1 is the outer table
+            Table* tbl1 = findTable(op->tbl1);
+            Table* tbl2 = findTable(op->tbl2);
+            // Look for an index on the inner table (tbl2)
+            bool innerIdxExists = false;
+                for (unsigned int i = 0; i < tbl2->idxs.size(); i++) {
+                    if (tbl2->idxs[i].name == op->join_col2) {
+                        innerIdxExists = true;
+                    }
+                }
+            // Pick the cheapest join algorithm for the inputs as written
+            JoinPlan outer = basePlan(tbl1);
+            JoinPlan inner = basePlan(tbl2);
+            JoinPlan joined = cheapestJoin(&outer, !tbl1->isOpTable, &inner, !tbl2->isOpTable, innerIdxExists && !tbl2->isOpTable,
+                                           1, lookupColumn(op->join_col1), lookupColumn(op->join_col2));
+            op->cost = joined.cost;
+            op->joinMethod = joined.method;
+        } else {
+            if (op->opType == "SELECTION") {
+                costSelection(op);
+            } else if (op->opType == "PROJECTION") {
+                // Perform projections on-the-fly, cost is zero as the input is pipelined.
+                // However we must file scan if the projection is happening on a base table.
+                Table* tbl1 = findTable(op->tbl1);
+                op->cost = 0;
+                op->access = AccessPath();
+                if (tbl1->isOpTable == false) {
+                    op->access = chooseAccessPath(tbl1, NULL, splitColumns(op->proj_cols));
+                    op->cost = op->access.cost;
+                }
+            }
+        }
+        // Row counts, widths and pages are carried bottom-up to the operations that read this one
+        estimateOperation(op);
+        recordCosting(i);
+    }
+}
+
+// Finds the base table node below a node that owns a given column
+Node* findColumnNode(Node* node, const string& column) {
+    if (node == NULL) {
+        return nullptr;
+    }
+    if (node->op->opType == "") {
+        return colExists(findTable(node->op->name), column) ? node : nullptr;
+    }
+    Node* found = findColumnNode(node->left, column);
+    return (found != nullptr) ? found : findColumnNode(node->right, column);
+}
+
+// Moves a selection down to just above the base table that owns its column, past joins and projections
+// Returns false if only other selections separate it from that table already
+bool pushDownSelection(Node* selNode) {
+    Node* baseNode = findColumnNode(selNode->left, selNode->op->sel_col);
+    if (baseNode == nullptr) {
+        return false;
+    }
+    Node* below = selNode->left;
+    while (below != baseNode && below->op->opType == "SELECTION") {
+        below = below->left;
+    }
+    if (below == baseNode) {
+        return false;
+    }
+    replaceChild(selNode->parent, selNode, selNode->left);
+    replaceChild(baseNode->parent, baseNode, selNode);
+    selNode->left = baseNode;
+    baseNode->parent = selNode;
+    selNode->op->tbl1 = baseNode->op->name;
+    localStats.counters[COUNT_REWRITES]++;
+    return true;
+}
+
+// For storing a predicate on one column as the closed range and the value list it allows, with a value it
+// excludes
+struct PredicateRange {
+    long long lo = INT_MIN;
+    long long hi = INT_MAX;
+    bool hasList = false;
+    vector<int> list;
+    bool hasExcluded = false;
+    int excluded = 0;
+};
+
+// Converts a selection into the range it allows
+PredicateRange predicateRange(Operation* sel) {
+    PredicateRange range;
+    long long v = sel->sel_val;
+    if (sel->sel_type == "=") {
+        range.lo = range.hi = v;
+    } else if (sel->sel_type == ">") {
+        range.lo = v + 1;
+    } else if (sel->sel_type == ">=") {
+        range.lo = v;
+    } else if (sel->sel_type == "<") {
+        range.hi = v - 1;
+    } else if (sel->sel_type == "<=") {
+        range.hi = v;
+    } else if (sel->sel_type == "BETWEEN") {
+        range.lo = v;
+        range.hi = sel->sel_hi;
+    } else if (sel->sel_type == "IN") {
+        range.hasList = true;
+        range.list = sel->sel_list;
+    } else if (sel->sel_type == "<>") {
+        range.hasExcluded = true;
+        range.excluded = v;
+    }
+    return range;
+}
+
+// Writes a range back into a selection as the simplest predicate that allows it
+// Returns false if the range still excludes a value inside it, which no single predicate can express
+bool setPredicate(Operation* sel, PredicateRange range) {
+    if (range.hasList) {
+        vector<int> kept;
+        for (unsigned int i = 0; i < range.list.size(); i++) {
+            int v = range.list[i];
+            if (v >= range.lo && v <= range.hi && !(range.hasExcluded && v == range.excluded)) {
+                kept.push_back(v);
+            }
+        }
+        range.list = kept;
+        range.hasExcluded = false;
+        if (!kept.empty()) {
+            range.lo = kept.front();
+            range.hi = kept.back();
+        } else {
+            range.lo = 1;
+            range.hi = 0;
+        }
+    }
+    // An excluded value at either end just narrows the range
+    if (range.hasExcluded && (range.excluded < range.lo || range.excluded > range.hi)) {
+        range.hasExcluded = false;
+    } else if (range.hasExcluded && range.excluded == range.lo && range.lo < range.hi) {
+        range.lo++;
+        range.hasExcluded = false;
+    } else if (range.hasExcluded && range.excluded == range.hi && range.lo < range.hi) {
+        range.hi--;
+        range.hasExcluded = false;
+    }
+    if (range.hasExcluded) {
+        if (range.lo != INT_MIN || range.hi != INT_MAX) {
+            return false;
+        }
+        sel->sel_type = "<>";
+        sel->sel_val = range.excluded;
+    } else if (range.hasList && range.list.size() > 1) {
+        sel->sel_type = "IN";
+        sel->sel_val = range.list[0];
+        sel->sel_list = range.list;
+    } else if (range.lo == range.hi) {
+        sel->sel_type = "=";
+        sel->sel_val = range.lo;
+    } else if (range.hi == INT_MAX) {
+        sel->sel_type = ">=";
+        sel->sel_val = range.lo;
+    } else if (range.lo == INT_MIN) {
+        sel->sel_type = "<=";
+        sel->sel_val = range.hi;
+    } else {
+        // Contradictory predicates leave an empty range, which stays a BETWEEN that matches nothing
+        sel->sel_type = "BETWEEN";
+        sel->sel_val = range.lo;
+        sel->sel_hi = range.hi;
+    }
+    if (sel->sel_type != "IN") {
+        sel->sel_list.clear();
+    }
+    return true;
+}
+
+// Merges the predicate of a selection on the same column into another one, returning false if the two
+// cannot be expressed as one predicate
+bool mergeSelections(Operation* into, Operation* from) {
+    PredicateRange a = predicateRange(into);
+    PredicateRange b = predicateRange(from);
+    if (a.hasExcluded && b.hasExcluded && a.excluded != b.excluded) {
+        return false;
+    }
+    PredicateRange merged;
+    merged.lo = max(a.lo, b.lo);
+    merged.hi = min(a.hi, b.hi);
+    if (a.hasList && b.hasList) {
+        merged.hasList = true;
+        set_intersection(a.list.begin(), a.list.end(), b.list.begin(), b.list.end(), back_inserter(merged.list));
+    } else if (a.hasList || b.hasList) {
+        merged.hasList = true;
+        merged.list = a.hasList ? a.list : b.list;
+    }
+    merged.hasExcluded = a.hasExcluded || b.hasExcluded;
+    merged.excluded = a.hasExcluded ? a.excluded : b.excluded;
+    Operation result = *into;
+    if (!setPredicate(&result, merged)) {
+        return false;
+    }
+    into->sel_type = result.sel_type;
+    into->sel_val = result.sel_val;
+    into->sel_hi = result.sel_hi;
+    into->sel_list = result.sel_list;
+    return true;
+}
+
+// Merges, orders and re-costs the chain of selections just above a base table
+// The selection with the cheapest access path goes to the bottom, where it is the one that reads the table.
+// The others filter its output on the fly, keeping the fraction of the table they would keep on their own
+void rewriteSelectionChain(Node* baseNode) {
+    vector<Node*> chain;
+    for (Node* node = baseNode->parent; node != NULL && node->op->opType == "SELECTION"; node = node->parent) {
+        chain.push_back(node);
+    }
+    Node* top = chain.back();
+    Node* parentNode = top->parent;
+    for (unsigned int i = 0; i < chain.size(); i++) {
+        for (unsigned int j = i + 1; j < chain.size(); j++) {
+            if (chain[i]->op->sel_col == chain[j]->op->sel_col && mergeSelections(chain[i]->op, chain[j]->op)) {
+                chain.erase(chain.begin() + j);
+                j--;
+                localStats.counters[COUNT_REWRITES]++;
+            }
+        }
+    }
+    Table* baseTbl = findTable(baseNode->op->name);
+    vector<pair<Node*, double>> fractions;
+    for (unsigned int i = 0; i < chain.size(); i++) {
+        chain[i]->op->tbl1 = baseNode->op->name;
+        costSelection(chain[i]->op);
+        double kept = findTable(chain[i]->op->name)->ntuples;
+        fractions.push_back(make_pair(chain[i], (baseTbl->ntuples > 0) ? kept/baseTbl->ntuples : 1));
+    }
+    stable_sort(fractions.begin(), fractions.end(), [](const pair<Node*, double>& a, const pair<Node*, double>& b) {
+        if (a.first->op->cost != b.first->op->cost) {
+            return a.first->op->cost < b.first->op->cost;
+        }
+        return a.second < b.second;
+    });
+    Node* below = baseNode;
+    for (unsigned int i = 0; i < fractions.size(); i++) {
+        Node* node = fractions[i].first;
+        node->left = below;
+        below->parent = node;
+        node->op->tbl1 = below->op->name;
+        costSelection(node->op);
+        if (i > 0) {
+            findTable(node->op->name)->ntuples = findTable(below->op->name)->ntuples*fractions[i].second;
+        }
+        estimateOperation(node->op);
+        below = node;
+    }
+    replaceChild(parentNode, top, below);
+}
+
+// Rewrites the selections of the query tree before the joins are ordered: each one is pushed down to the
+// base table that owns its column, and the selections gathered above a table are merged where they are on
+// the same column and ordered so the cheapest access path reads the table
+void pushDownSelections(Node* root) {
+    vector<Node*> nodes;
+    collectNodes(root, &nodes);
+    for (unsigned int i = 0; i < nodes.size(); i++) {
+        if (nodes[i]->op->opType == "SELECTION") {
+            pushDownSelection(nodes[i]);
+        }
+    }
+    vector<Node*> bases;
+    collectNodes(query.tree.root, &bases);
+    for (unsigned int i = 0; i < bases.size(); i++) {
+        Node* parentNode = bases[i]->parent;
+        if (bases[i]->op->opType == "" && parentNode != NULL && parentNode->op->opType == "SELECTION") {
+            rewriteSelectionChain(bases[i]);
+        }
+    }
+}
+
+// Narrows a join input that reads a single base table to the columns needed above it, returning the node
+// that now feeds the join
+// A projection already on the input is narrowed in place, otherwise one named TABLE.PROJ is added on top. A
+// base table read on its own keeps its full width if the join could probe an index on it, since a
+// projected input can no longer be probed
+Node* projectInput(Node* joinNode, Node* input, const vector<string>& needed) {
+    if (!filtersBaseTable(input)) {
+        return input;
+    }
+    Node* baseNode = input;
+    while (baseNode->op->opType != "") {
+        baseNode = baseNode->left;
+    }
+    Table* baseTbl = findTable(baseNode->op->name);
+    bool projected = (input->op->opType == "PROJECTION");
+    vector<string> cols = projected ? splitColumns(input->op->proj_cols) : baseTbl->columns;
+    vector<string> keep;
+    for (unsigned int i = 0; i < cols.size(); i++) {
+        if (find(needed.begin(), needed.end(), cols[i]) != needed.end()) {
+            keep.push_back(cols[i]);
+        }
+    }
+    if (keep.empty() || keep.size() == cols.size()) {
+        return input;
+    }
+    if (input == baseNode && (findIndex(baseTbl, joinNode->op->join_col1) != nullptr || findIndex(baseTbl, joinNode->op->join_col2) != nullptr)) {
+        return input;
+    }
+    Operation* op = input->op;
+    Node* projNode = input;
+    if (!projected) {
+        Operation proj;
+        proj.name = baseTbl->name + ".PROJ";
+        proj.opType = "PROJECTION";
+        proj.tbl1 = input->op->name;
+        proj.inherit_tbls = {input->op->name};
+        op = query.tree.addedOps.add(proj);
+        Table newTbl;
+        newTbl.name = op->name;
+        newTbl.isOpTable = true;
+        query.opTables.addTable(newTbl);
+        Table* opTable = findTable(op->name);
+        Table* inputTbl = findTable(op->tbl1);
+        copyTableRfs(opTable, inputTbl);
+        copyTablePks(opTable, inputTbl);
+        copyTableFks(opTable, inputTbl);
+        query.tree.nodeIds[op->name] = query.tree.nodes.size();
+        projNode = query.tree.nodes.add(Node(op));
+        localStats.counters[COUNT_NODES]++;
+        replaceChild(joinNode, input, projNode);
+        projNode->left = input;
+        input->parent = projNode;
+    }
+    op->proj_cols = joinNames(keep);
+    op->cost = 0;
+    op->access = AccessPath();
+    if (op->tbl1 == baseNode->op->name) {
+        op->access = chooseAccessPath(baseTbl, NULL, keep);
+        op->cost = op->access.cost;
+    }
+    estimateOperation(op);
+    localStats.counters[COUNT_REWRITES]++;
+    return projNode;
+}
+
+// Passes the columns the operations above a node read down to the joins below it, narrowing their inputs
+// all is set while every column is still needed, which holds until the first projection
+void narrowJoinInputs(Node* node, bool all, vector<string> needed) {
+    if (node == NULL || node->op->opType == "") {
+        return;
+    }
+    Operation* op = node->op;
+    if (op->opType == "PROJECTION") {
+        narrowJoinInputs(node->left, false, splitColumns(op->proj_cols));
+    } else if (op->opType == "SELECTION") {
+        needed.push_back(op->sel_col);
+        narrowJoinInputs(node->left, all, needed);
+    } else if (op->opType == "JOIN") {
+        needed.push_back(op->join_col1);
+        needed.push_back(op->join_col2);
+        Node* inputs[2] = {node->left, node->right};
+        for (unsigned int i = 0; i < 2; i++) {
+            Node* input = all ? inputs[i] : projectInput(node, inputs[i], needed);
+            narrowJoinInputs(input, all, needed);
+        }
+    }
+}
+
+// Rewrites the projections of the query tree before the joins are ordered: every join input that reads a
+// single base table only passes on the columns some operation above it reads, along with the join keys,
+// so narrower tuples flow through the joins
+void pushDownProjections(Node* root) {
+    narrowJoinInputs(root, true, vector<string>());
+}
+
+// Finds the table a statement refers to, reporting it if it does not exist
+Table* statementTable(const Statement& stmt) {
+    Table* tbl = findTable(stmt.table);
+    if (tbl == nullptr) {
+        throw ParseError("unknown table " + stmt.table, stmt.line, stmt.tableCol);
+    }
+    return tbl;
+}
+
+// Finds the index a statistics statement refers to, creating it if it is new
+Index* statementIndex(const Statement& stmt) {
+    Table* tbl = statementTable(stmt);
+    Index* idx = findIndex(tbl, stmt.column);
+    if (idx == nullptr) {
+        Index newIdx;
+        newIdx.name = stmt.column;
+        tbl->addIndex(newIdx);
+        idx = findIndex(tbl, stmt.column);
+    }
+    return idx;
+}
+
+// Processes table statement and stores details
+void processTable(const Statement& stmt) {
+    Table newTbl;
+    newTbl.setName(stmt.table);
+    for (unsigned int i = 0; i < stmt.pks.size(); i++) {
+        newTbl.addPK(stmt.pks[i]);
+    }
+    for (unsigned int i = 0; i < stmt.columns.size(); i++) {
+        newTbl.addColumn(stmt.columns[i]);
+    }
+    newTbl.isOpTable = false;
+    catalog.addTable(newTbl);
+}
+
+// Processes foreign key statement and stores details
+void processForeign(const Statement& stmt) {
+    statementTable(stmt)->addFK(stmt.fk);
+}
+
+// Adds an operation and the table holding its output to the query
+void addOperation(const Operation& op) {
+    Table newTbl;
+    newTbl.name = op.name;
+    newTbl.isOpTable = true;
+    query.opTables.addTable(newTbl);
+    query.operationIds[op.name] = query.operations.size();
+    query.operations.push_back(op);
+}
+
+// Function to process OPERATION statement
+// A selection of several ANDed predicates is split into a chain of single-predicate selections, so each
+// one can be pushed down on its own. The last keeps the statement's name, the others are named NAME.1, ...
+void processOP(const Statement& stmt) {
+    // Every input has to be a table or an operation defined before, which also rejects the uses of a skipped statement
+    string inputs[2] = {stmt.op.tbl1, stmt.op.tbl2};
+    int cols[2] = {stmt.tableCol, stmt.table2Col};
+    for (unsigned int i = 0; i < 2; i++) {
+        if (inputs[i] != "" && findTable(inputs[i]) == nullptr) {
+            throw ParseError("unknown table or operation " + inputs[i], stmt.line, cols[i]);
+        }
+    }
+    localStats.counters[COUNT_STATEMENTS]++;
+    if (stmt.conjuncts.empty()) {
+        addOperation(stmt.op);
+        return;
+    }
+    vector<Operation> chain = {stmt.op};
+    chain.insert(chain.end(), stmt.conjuncts.begin(), stmt.conjuncts.end());
+    string input = stmt.op.tbl1;
+    for (unsigned int i = 0; i < chain.size(); i++) {
+        Operation op = chain[i];
+        op.name = (i + 1 < chain.size()) ? stmt.op.name + "." + to_string(i + 1) : stmt.op.name;
+        op.tbl1 = input;
+        op.inherit_tbls = {input};
+        addOperation(op);
+        input = op.name;
+    }
+}
+
+// Function to process CARDINALITY statement
+void processCard(const Statement& stmt) {
+    // Check if Cardinality of TABLE or Index Column
+    if (stmt.column == "") {
+        statementTable(stmt)->ntuples = stmt.value;
+    } else {
+        statementIndex(stmt)->nkeys = stmt.value;
+    }
+}
+
+// Function to process SIZE statement
+void processSize(const Statement& stmt) {
+    // Check if Size of TABLE or Index Column
+    if (stmt.column == "") {
+        statementTable(stmt)->npages = stmt.value;
+    } else {
+        statementIndex(stmt)->npages = stmt.value;
+    }
+}
+
+// Function to process RF statement
+void processRF(const Statement& stmt) {
+    Table* tbl = statementTable(stmt);
+    // A resident catalog can receive fresh statistics for an existing column
+    RF* existing = findRF(tbl, stmt.column);
+    if (existing != nullptr) {
+        existing->rfVal = stmt.value;
+        return;
+    }
+    RF currRF;
+    currRF.colName = stmt.column;
+    currRF.rfVal = stmt.value;
+    tbl->addRF(currRF);
+}
+
+// Function to process WIDTH statement
+void processWidth(const Statement& stmt) {
+    Table* tbl = statementTable(stmt);
+    ColumnWidth* existing = findWidth(tbl, stmt.column);
+    if (existing != nullptr) {
+        existing->bytes = stmt.value;
+        return;
+    }
+    ColumnWidth width;
+    width.colName = stmt.column;
+    width.bytes = stmt.value;
+    tbl->addWidth(width);
+}
+
+// Function to process HEIGHT statement
+void processHeight(const Statement& stmt) {
+    statementIndex(stmt)->height = stmt.value;
+}
+
+// Function to process RANGE statement
+void processRange(const Statement& stmt) {
+    Index* idx = statementIndex(stmt);
+    idx->min = stmt.value;
+    idx->max = stmt.value2;
+}
+
+// Finds the distribution statistics a statement refers to, creating them if they are new
+ColumnStats* statementColumnStats(const Statement& stmt) {
+    Table* tbl = statementTable(stmt);
+    ColumnStats* stats = findColumnStats(tbl, stmt.column);
+    if (stats == nullptr) {
+        ColumnStats newStats;
+        newStats.colName = stmt.column;
+        tbl->addColumnStats(newStats);
+        stats = findColumnStats(tbl, stmt.column);
+    }
+    return stats;
+}
+
+// Function to process HISTOGRAM statement
+void processHistogram(const Statement& stmt) {
+    ColumnStats* stats = statementColumnStats(stmt);
+    stats->bounds = stmt.values;
+    stats->cumFreqs.clear();
+    int nbuckets = stmt.values.size() - 1;
+    for (int i = 0; i <= nbuckets; i++) {
+        stats->cumFreqs.push_back((double)i/nbuckets);
+    }
+}
+
+// Function to process MCV statement
+void processMCV(const Statement& stmt) {
+    ColumnStats* stats = statementColumnStats(stmt);
+    vector<pair<double, double>> mcvs;
+    for (unsigned int i = 0; i < stmt.values.size(); i++) {
+        mcvs.push_back(make_pair(stmt.values[i], stmt.values2[i]));
+    }
+    sort(mcvs.begin(), mcvs.end());
+    stats->mcvValues.clear();
+    stats->mcvCumFreqs.clear();
+    double total = 0;
+    for (unsigned int i = 0; i < mcvs.size(); i++) {
+        total += mcvs[i].second;
+        stats->mcvValues.push_back(mcvs[i].first);
+        stats->mcvCumFreqs.push_back(total);
+    }
+}
+
+// Function to process all statement
+void processStatement(const Statement& stmt) {
+    if (stmt.kind == STMT_OP) {
+        processOP(stmt);
+        return;
+    }
+    catalogVersion++;
+    localStats.counters[COUNT_STATEMENTS]++;
+    switch (stmt.kind) {
+        case STMT_TABLE:
+            processTable(stmt);
+            break;
+        case STMT_FOREIGN:
+            processForeign(stmt);
+            break;
+        case STMT_CARDINALITY:
+            processCard(stmt);
+            break;
+        case STMT_SIZE:
+            processSize(stmt);
+            break;
+        case STMT_RF:
+            processRF(stmt);
+            break;
+        case STMT_HEIGHT:
+            processHeight(stmt);
+            break;
+        case STMT_RANGE:
+            processRange(stmt);
+            break;
+        case STMT_HISTOGRAM:
+            processHistogram(stmt);
+            break;
+        case STMT_MCV:
+            processMCV(stmt);
+            break;
+        case STMT_WIDTH:
+            processWidth(stmt);
+            break;
+        default:
+            break;
+    }
+    // Plans that read the table have to be costed again
+    statementTable(stmt)->version = catalogVersion;
+}
+
+// Parses and applies one line of input, reporting malformed statements to err
+// Returns the kind of statement, or STMT_NONE for blank and malformed lines
+StatementKind processLine(string_view line, int lineNo, const string& source, ostream& err, bool catalogOnly) {
+    PhaseTimer timer(PHASE_PARSE);
+    try {
+        Statement stmt = parseStatement(line, lineNo);
+        if (stmt.kind == STMT_NONE || (catalogOnly && stmt.kind == STMT_OP)) {
+            return stmt.kind;
+        }
+        processStatement(stmt);
+        return stmt.kind;
+    } catch (const ParseError& e) {
+        err << source << ":" << e.line << ":" << e.col << ": error: " << e.what() << endl;
+        return STMT_NONE;
+    }
+}
+
+// For storing one node of a cached plan
+// Operations are referred to by their position in the query so renamed operations still match
+struct CachedNode {
+    string ref;
+    int left = -1;
+    int right = -1;
+};
+
+// For storing the rewritten operation fields of a cached plan
+struct CachedJoin {
+    string tbl1;
+    string tbl2;
+    string join_col1;
+    string join_col2;
+    JoinMethod joinMethod = JOIN_NONE;
+};
+
+// For storing the shape of an optimized plan along with what it was derived from
+// Every operation depends on the base tables below it and every join subset on the tables of its leaves,
+// so a change to one table only invalidates the costings and subsets it feeds into
+struct CachedPlan {
+    vector<CachedNode> nodes;
+    vector<CachedJoin> joins;
+    // Base tables the query reads, with their catalog versions when the plan was made
+    vector<pair<string, long>> tables;
+    vector<CachedCosting> costings;
+    vector<CachedMemo> memos;
+    // Approximate bytes the plan holds, counted against the byte limit of the plan cache
+    size_t bytes = 0;
+};
+
+// Returns the approximate bytes held by a memo table
+size_t memoBytes(const shared_ptr<const vector<vector<JoinPlan>>>& memo) {
+    if (!memo) {
+        return 0;
+    }
+    size_t bytes = memo->capacity()*sizeof(vector<JoinPlan>);
+    for (unsigned int i = 0; i < memo->size(); i++) {
+        bytes += (*memo)[i].capacity()*sizeof(JoinPlan);
+    }
+    return bytes;
+}
+
+// Returns the approximate bytes held by a cached plan, dominated by the memo tables of its join blocks
+size_t planBytes(const CachedPlan& plan) {
+    size_t bytes = sizeof(CachedPlan) + plan.nodes.size()*sizeof(CachedNode) + plan.joins.size()*sizeof(CachedJoin) +
+                   plan.tables.size()*sizeof(pair<string, long>) + plan.costings.size()*sizeof(CachedCosting);
+    for (unsigned int i = 0; i < plan.memos.size(); i++) {
+        bytes += sizeof(CachedMemo) + memoBytes(plan.memos[i].memo) + memoBytes(plan.memos[i].crossMemo);
+    }
+    return bytes;
+}
+
+// Checks whether none of the tables a cached plan read has changed since it was made
+bool planCurrent(const CachedPlan& plan) {
+    for (unsigned int i = 0; i < plan.tables.size(); i++) {
+        Table* tbl = catalog.findTable(plan.tables[i].first);
+        if (tbl == nullptr || tbl->version != plan.tables[i].second) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// LRU cache of optimized plans keyed by query fingerprint, shared by every thread
+class PlanCache {
+    public:
+        int capacity = 1024;
+        // Memo tables grow with every subset of a join block, so the cache is limited by bytes as well
+        size_t maxBytes = 256 << 20;
+        long hits = 0;
+        long misses = 0;
+
+        // Returns true if the plan for a key is still current
+        // A plan made before one of its tables changed is copied out too, so its unaffected parts can be reused
+        bool get(const string& key, CachedPlan* plan) {
+            lock_guard<mutex> guard(lock);
+            auto it = entries.find(key);
+            if (it == entries.end()) {
+                misses++;
+                return false;
+            }
+            // Move the entry to the front of the recency list
+            recency.splice(recency.begin(), recency, it->second.second);
+            *plan = it->second.first;
+            if (!planCurrent(*plan)) {
+                misses++;
+                return false;
+            }
+            hits++;
+            return true;
+        }
+        // Counts a hit whose plan turned out not to fit the query as a miss
+        void reject() {
+            lock_guard<mutex> guard(lock);
+            hits--;
+            misses++;
+        }
+        // Stores the plan for a key, replacing a stale one, and evicts the least recently used plans over the limits
+        // A plan too large for the byte limit on its own is kept without its memo tables
+        void put(const string& key, CachedPlan plan) {
+            if (capacity <= 0) {
+                return;
+            }
+            plan.bytes = planBytes(plan);
+            if (plan.bytes > maxBytes) {
+                plan.memos.clear();
+                plan.bytes = planBytes(plan);
+            }
+            lock_guard<mutex> guard(lock);
+            auto it = entries.find(key);
+            if (it != entries.end()) {
+                recency.splice(recency.begin(), recency, it->second.second);
+                bytes -= it->second.first.bytes;
+                it->second.first = move(plan);
+            } else {
+                recency.push_front(key);
+                entries[key] = make_pair(move(plan), recency.begin());
+            }
+            bytes += entries[key].first.bytes;
+            while ((int)entries.size() > capacity || (bytes > maxBytes && entries.size() > 1)) {
+                auto victim = entries.find(recency.back());
+                bytes -= victim->second.first.bytes;
+                entries.erase(victim);
+                recency.pop_back();
+            }
+        }
+
+    private:
+        mutex lock;
+        size_t bytes = 0;
+        list<string> recency;
+        unordered_map<string, pair<CachedPlan, list<string>::iterator>> entries;
+};
+
+PlanCache planCache;
+
+// Refers to a table or operation by position so the reference does not depend on operation names
+string planRef(const string& name) {
+    auto it = query.operationIds.find(name);
+    if (it == query.operationIds.end() || name == "RESULT") {
+        return name;
+    }
+    return "#" + to_string(it->second);
+}
+
+// Turns a plan reference back into the name of a table or operation
+string resolveRef(const string& ref) {
+    if (ref.size() > 1 && ref[0] == '#') {
+        return query.operations[stoi(ref.substr(1))].name;
+    }
+    return ref;
+}
+
+// Builds a canonical fingerprint of the operations of the query
+// Selection constants are left out, so queries that only differ in constants share a plan. The catalog
+// is left out too: a cached plan records the versions of the tables it read instead
+string queryFingerprint() {
+    ostringstream key;
+    key << (bushyJoins ? "B" : "L") << ";";
+    for (unsigned int i = 0; i < query.operations.size(); i++) {
+        Operation* op = &(query.operations[i]);
+        key << planRef(op->name) << "=" << op->opType << "(" << planRef(op->tbl1);
+        if (op->opType == "JOIN") {
+            key << "," << planRef(op->tbl2) << "," << op->join_col1 << "=" << op->join_col2;
+        } else if (op->opType == "SELECTION") {
+            key << "," << op->sel_col << op->sel_type << "?";
+        } else if (op->opType == "PROJECTION") {
+            key << "," << op->proj_cols;
+        }
+        key << ");";
+    }
+    return key.str();
+}
+
+// Records the shape of a subtree of the optimized plan, returning its position
+int capturePlanNode(Node* node, CachedPlan* plan) {
+    if (node == NULL) {
+        return -1;
+    }
+    int pos = plan->nodes.size();
+    plan->nodes.push_back(CachedNode());
+    plan->nodes[pos].ref = planRef(node->op->name);
+    int left = capturePlanNode(node->left, plan);
+    int right = capturePlanNode(node->right, plan);
+    plan->nodes[pos].left = left;
+    plan->nodes[pos].right = right;
+    return pos;
+}
+
+// Records the shape of the optimized plan along with the rewritten join fields
+CachedPlan capturePlan(Node* root) {
+    CachedPlan plan;
+    capturePlanNode(root, &plan);
+    for (unsigned int i = 0; i < query.operations.size(); i++) {
+        Operation* op = &(query.operations[i]);
+        CachedJoin join;
+        join.tbl1 = planRef(op->tbl1);
+        join.tbl2 = planRef(op->tbl2);
+        join.join_col1 = op->join_col1;
+        join.join_col2 = op->join_col2;
+        join.joinMethod = op->joinMethod;
+        plan.joins.push_back(join);
+        string inputs[2] = {op->tbl1, op->tbl2};
+        for (unsigned int j = 0; j < 2; j++) {
+            Table* tbl = catalog.findTable(inputs[j]);
+            if (inputs[j] != "" && !opExists(inputs[j]) && tbl != nullptr) {
+                plan.tables.push_back(make_pair(inputs[j], tbl->version));
+            }
+        }
+    }
+    // A projection added by the rewrites may be the only operation reading its table
+    for (int i = 0; i < query.tree.addedOps.size(); i++) {
+        Table* tbl = catalog.findTable(query.tree.addedOps[i].tbl1);
+        if (tbl != nullptr) {
+            plan.tables.push_back(make_pair(tbl->name, tbl->version));
+        }
+    }
+    plan.costings = reuse.costings;
+    plan.memos = reuse.memos;
+    return plan;
+}
+
+// Starts an optimization from the plan cached for the query shape, which may be stale or empty
+void startReuse(const CachedPlan& previous) {
+    reuse = ReuseContext();
+    for (unsigned int i = 0; i < previous.tables.size(); i++) {
+        reuse.versions[previous.tables[i].first] = previous.tables[i].second;
+    }
+    reuse.previousCostings = previous.costings;
+    reuse.previousMemos = previous.memos;
+}
+
+// Relinks the query tree into the shape of a cached plan, returning false if the plan does not fit it
+// Constants are not part of the fingerprint but decide whether conjuncts merge, so the rewritten tree
+// can hold different nodes than the tree the plan was made from
+bool applyPlan(CachedPlan* plan) {
+    vector<Node*> nodes;
+    for (unsigned int i = 0; i < plan->nodes.size(); i++) {
+        nodes.push_back(findNode(resolveRef(plan->nodes[i].ref)));
+    }
+    vector<Node*> planned = nodes;
+    vector<Node*> current;
+    collectNodes(query.tree.root, &current);
+    sort(planned.begin(), planned.end());
+    sort(current.begin(), current.end());
+    if (planned.empty() || planned[0] == NULL || planned != current) {
+        return false;
+    }
+    for (unsigned int i = 0; i < plan->nodes.size(); i++) {
+        Node* node = nodes[i];
+        node->left = (plan->nodes[i].left != -1) ? nodes[plan->nodes[i].left] : NULL;
+        node->right = (plan->nodes[i].right != -1) ? nodes[plan->nodes[i].right] : NULL;
+        if (node->left != NULL) {
+            node->left->parent = node;
+        }
+        if (node->right != NULL) {
+            node->right->parent = node;
+        }
+    }
+    nodes[0]->parent = NULL;
+    query.tree.root = nodes[0];
+    for (unsigned int i = 0; i < query.operations.size(); i++) {
+        Operation* op = &(query.operations[i]);
+        op->tbl1 = resolveRef(plan->joins[i].tbl1);
+        op->tbl2 = resolveRef(plan->joins[i].tbl2);
+        op->join_col1 = plan->joins[i].join_col1;
+        op->join_col2 = plan->joins[i].join_col2;
+        op->joinMethod = plan->joins[i].joinMethod;
+    }
+    return true;
+}
+
+// Pool of worker threads that each own a deque of tasks and steal from the others when idle
+class WorkStealingPool {
+    public:
+        WorkStealingPool(int nthreads) {
+            for (int i = 0; i < nthreads; i++) {
+                queues.push_back(unique_ptr<WorkQueue>(new WorkQueue()));
+            }
+        }
+
+        // Hands out task IDs 0..ntasks-1 in contiguous runs and starts the workers
+        void start(int ntasks, function<void(int)> task) {
+            startWorkers(ntasks, [task](int t, int w) { task(t); });
+        }
+        // Same as start, but also tells each task the index of the worker running it
+        void startWorkers(int ntasks, function<void(int, int)> task) {
+            int nthreads = queues.size();
+            for (int w = 0; w < nthreads; w++) {
+                int first = (long)ntasks * w / nthreads;
+                int last = (long)ntasks * (w + 1) / nthreads;
+                for (int t = first; t < last; t++) {
+                    queues[w]->tasks.push_back(t);
+                }
+            }
+            for (int w = 0; w < nthreads; w++) {
+                workers.push_back(thread([this, w, task]() {
+                    int t;
+                    while (popTask(w, &t) || stealTask(w, &t)) {
+                        task(t, w);
+                    }
+                }));
+            }
+        }
+
+        // Waits for every task to finish
+        void wait() {
+            for (unsigned int i = 0; i < workers.size(); i++) {
+                workers[i].join();
+            }
+            workers.clear();
+        }
+
+    private:
+        struct WorkQueue {
+            mutex lock;
+            deque<int> tasks;
+        };
+        vector<unique_ptr<WorkQueue>> queues;
+        vector<thread> workers;
+
+        // Takes the next task from the front of a worker's own queue
+        bool popTask(int w, int* t) {
+            lock_guard<mutex> guard(queues[w]->lock);
+            if (queues[w]->tasks.empty()) {
+                return false;
+            }
+            *t = queues[w]->tasks.front();
+            queues[w]->tasks.pop_front();
+            return true;
+        }
+
+        // Takes a task from the back of another worker's queue
+        bool stealTask(int w, int* t) {
+            int nthreads = queues.size();
+            for (int i = 1; i < nthreads; i++) {
+                WorkQueue* victim = queues[(w + i) % nthreads].get();
+                lock_guard<mutex> guard(victim->lock);
+                if (!victim->tasks.empty()) {
+                    *t = victim->tasks.back();
+                    victim->tasks.pop_back();
+                    return true;
+                }
+            }
+            return false;
+        }
+};
+
+// Read-only memory mapping of a whole input file
+class MappedFile {
+    public:
+        const char* data = NULL;
+        size_t size = 0;
+
+        MappedFile() {}
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile() {
+            if (data != NULL && size > 0) {
+                munmap((void*)data, size);
+            }
+        }
+
+        bool open(string fileName) {
+            int fd = ::open(fileName.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat info;
+            if (fstat(fd, &info) < 0) {
+                close(fd);
+                return false;
+            }
+            size = info.st_size;
+            if (size > 0) {
+                void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapped == MAP_FAILED) {
+                    close(fd);
+                    size = 0;
+                    return false;
+                }
+                // Statements are read front to back, so let the kernel read ahead aggressively
+                madvise(mapped, size, MADV_SEQUENTIAL);
+                data = (const char*)mapped;
+            }
+            close(fd);
+            return true;
+        }
+};
+
+// Number of statement threads used when loading input files (--parse-threads)
+int parseThreads = 1;
+
+// Files smaller than this are never split into chunks
+const size_t MIN_PARSE_CHUNK = 1 << 20;
+
+// For storing the statements parsed from one chunk of an input file
+struct ParsedChunk {
+    string_view text;
+    int lines = 0;
+    vector<Statement> stmts;
+    // Parse errors, as (line within chunk, formatted message without the file name)
+    vector<pair<int, string>> errors;
+};
+
+// Calls a function for every line of a block of text, along with its 1-based line number
+template <typename F>
+int forEachLine(string_view text, F handleLine) {
+    int lineNo = 0;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        const char* newline = (const char*)memchr(text.data() + pos, '\n', text.size() - pos);
+        size_t end = (newline != NULL) ? newline - text.data() : text.size();
+        handleLine(text.substr(pos, end - pos), ++lineNo);
+        pos = end + 1;
+    }
+    return lineNo;
+}
+
+// Parses a chunk of an input file without touching the catalog
+void parseChunk(ParsedChunk* chunk, bool catalogOnly) {
+    PhaseTimer timer(PHASE_PARSE);
+    chunk->lines = forEachLine(chunk->text, [&](string_view line, int lineNo) {
+        try {
+            Statement stmt = parseStatement(line, lineNo);
+            if (stmt.kind != STMT_NONE && !(catalogOnly && stmt.kind == STMT_OP)) {
+                chunk->stmts.push_back(move(stmt));
+            }
+        } catch (const ParseError& e) {
+            chunk->errors.push_back(make_pair(e.line, to_string(e.col) + ": error: " + e.what()));
+        }
+    });
+}
+
+// Applies the statements of a parsed chunk in line order, reporting errors as it goes
+void applyChunk(ParsedChunk* chunk, int lineOffset, const string& source) {
+    PhaseTimer timer(PHASE_PARSE);
+    unsigned int nextError = 0;
+    for (unsigned int i = 0; i <= chunk->stmts.size(); i++) {
+        int line = (i < chunk->stmts.size()) ? chunk->stmts[i].line : chunk->lines + 1;
+        while (nextError < chunk->errors.size() && chunk->errors[nextError].first < line) {
+            cerr << source << ":" << chunk->errors[nextError].first + lineOffset << ":" << chunk->errors[nextError].second << endl;
+            nextError++;
+        }
+        if (i == chunk->stmts.size()) {
+            break;
+        }
+        Statement& stmt = chunk->stmts[i];
+        stmt.line += lineOffset;
+        try {
+            processStatement(stmt);
+        } catch (const ParseError& e) {
+            cerr << source << ":" << e.line << ":" << e.col << ": error: " << e.what() << endl;
+        }
+    }
+}
+
+// Binary catalog snapshots written by --compile-catalog
+// A snapshot is a header followed by arrays of fixed-width records and a string table. Records name
+// their strings by offset and length in the string table, and every section is 8-byte aligned so
+// the records can be read in place from a read-only mapping
+const char SNAPSHOT_MAGIC[8] = {'Q', 'O', 'C', 'A', 'T', 'L', 'G', '\0'};
+const uint32_t SNAPSHOT_VERSION = 3;
+
+struct SnapString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+// Columns and primary keys of a table are stored back to back in the names section
+struct SnapTable {
+    SnapString name;
+    uint32_t firstName;
+    uint32_t ncolumns;
+    uint32_t npks;
+    uint32_t firstFk;
+    uint32_t nfks;
+    uint32_t firstIdx;
+    uint32_t nidxs;
+    uint32_t firstRf;
+    uint32_t nrfs;
+    uint32_t firstStat;
+    uint32_t nstats;
+    uint32_t firstWidth;
+    uint32_t nwidths;
+    int32_t ntuples;
+    double npages;
+    double tuplesPerPage;
+};
+
+struct SnapIndex {
+    SnapString name;
+    int32_t nkeys;
+    int32_t height;
+    int32_t min;
+    int32_t max;
+    double npages;
+};
+
+struct SnapRF {
+    SnapString colName;
+    double rfVal;
+};
+
+struct SnapWidth {
+    SnapString colName;
+    double bytes;
+};
+
+// The values section holds the MCV values, MCV cumulative frequencies, bucket boundaries and
+// cumulative bucket fractions of each column back to back, starting at firstValue
+struct SnapColumnStats {
+    SnapString colName;
+    uint32_t firstValue;
+    uint32_t nmcvs;
+    uint32_t nbounds;
+    uint32_t reserved;
+};
+
+struct SnapFK {
+    SnapString col;
+    SnapString ref_table;
+    SnapString ref_col;
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    // FNV-1a over every byte after the header
+    uint64_t checksum;
+    uint64_t fileSize;
+    uint32_t ntables;
+    uint32_t nnames;
+    uint32_t nfks;
+    uint32_t nidxs;
+    uint32_t nrfs;
+    uint32_t nstats;
+    uint32_t nvalues;
+    uint32_t nwidths;
+    uint64_t tablesOffset;
+    uint64_t namesOffset;
+    uint64_t fksOffset;
+    uint64_t idxsOffset;
+    uint64_t rfsOffset;
+    uint64_t statsOffset;
+    uint64_t valuesOffset;
+    uint64_t widthsOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+};
+
+static_assert(sizeof(SnapTable) == 80 && sizeof(SnapIndex) == 32 && sizeof(SnapRF) == 16 && sizeof(SnapFK) == 24 &&
+              sizeof(SnapColumnStats) == 24 && sizeof(SnapWidth) == 16, "snapshot records must keep a fixed width");
+static_assert(sizeof(SnapshotHeader) == 144, "snapshot header must keep a fixed width");
+
+// 64-bit FNV-1a hash of a block of bytes
+uint64_t fnv1a(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Collects the sections of a snapshot before they are written out
+class SnapshotWriter {
+    public:
+        vector<SnapTable> tables;
+        vector<SnapString> names;
+        vector<SnapFK> fks;
+        vector<SnapIndex> idxs;
+        vector<SnapRF> rfs;
+        vector<SnapColumnStats> stats;
+        vector<double> values;
+        vector<SnapWidth> widths;
+        string strings;
+        unordered_map<string, SnapString> stringIds;
+
+        // Adds a string to the string table, sharing repeated names
+        SnapString addString(const string& str) {
+            auto it = stringIds.find(str);
+            if (it != stringIds.end()) {
+                return it->second;
+            }
+            SnapString ref = {(uint32_t)strings.size(), (uint32_t)str.size()};
+            strings += str;
+            stringIds[str] = ref;
+            return ref;
+        }
+
+        void addTable(const Table& tbl) {
+            SnapTable rec = {};
+            rec.name = addString(tbl.name);
+            rec.firstName = names.size();
+            rec.ncolumns = tbl.columns.size();
+            rec.npks = tbl.pks.size();
+            for (unsigned int i = 0; i < tbl.columns.size(); i++) {
+                names.push_back(addString(tbl.columns[i]));
+            }
+            for (unsigned int i = 0; i < tbl.pks.size(); i++) {
+                names.push_back(addString(tbl.pks[i]));
+            }
+            rec.firstFk = fks.size();
+            rec.nfks = tbl.fks.size();
+            for (unsigned int i = 0; i < tbl.fks.size(); i++) {
+                fks.push_back({addString(tbl.fks[i].col), addString(tbl.fks[i].ref_table), addString(tbl.fks[i].ref_col)});
+            }
+            rec.firstIdx = idxs.size();
+            rec.nidxs = tbl.idxs.size();
+            for (unsigned int i = 0; i < tbl.idxs.size(); i++) {
+                const Index& idx = tbl.idxs[i];
+                idxs.push_back({addString(idx.name), idx.nkeys, idx.height, idx.min, idx.max, idx.npages});
+            }
+            rec.firstRf = rfs.size();
+            rec.nrfs = tbl.rfs.size();
+            for (unsigned int i = 0; i < tbl.rfs.size(); i++) {
+                rfs.push_back({addString(tbl.rfs[i].colName), tbl.rfs[i].rfVal});
+            }
+            rec.firstStat = stats.size();
+            rec.nstats = tbl.colStats.size();
+            for (unsigned int i = 0; i < tbl.colStats.size(); i++) {
+                const ColumnStats& colStats = tbl.colStats[i];
+                SnapColumnStats statRec = {};
+                statRec.colName = addString(colStats.colName);
+                statRec.firstValue = values.size();
+                statRec.nmcvs = colStats.mcvValues.size();
+                statRec.nbounds = colStats.bounds.size();
+                values.insert(values.end(), colStats.mcvValues.begin(), colStats.mcvValues.end());
+                values.insert(values.end(), colStats.mcvCumFreqs.begin(), colStats.mcvCumFreqs.end());
+                values.insert(values.end(), colStats.bounds.begin(), colStats.bounds.end());
+                values.insert(values.end(), colStats.cumFreqs.begin(), colStats.cumFreqs.end());
+                stats.push_back(statRec);
+            }
+            rec.firstWidth = widths.size();
+            rec.nwidths = tbl.widths.size();
+            for (unsigned int i = 0; i < tbl.widths.size(); i++) {
+                widths.push_back({addString(tbl.widths[i].colName), tbl.widths[i].bytes});
+            }
+            rec.ntuples = tbl.ntuples;
+            rec.npages = tbl.npages;
+            rec.tuplesPerPage = tbl.tuplesPerPage;
+            tables.push_back(rec);
+        }
+};
+
+// Appends a section to a snapshot image, padded to 8 bytes, and returns its offset
+template <typename T>
+uint64_t appendSection(string* image, const vector<T>& records) {
+    uint64_t offset = image->size();
+    image->append((const char*)records.data(), records.size() * sizeof(T));
+    image->resize((image->size() + 7) & ~(size_t)7, '\0');
+    return offset;
+}
+
+// Writes the base tables of the catalog to a binary snapshot file
+bool writeSnapshot(string fileName) {
+    SnapshotWriter writer;
+    for (unsigned int i = 0; i < catalog.tables.size(); i++) {
+        writer.addTable(catalog.tables[i]);
+    }
+
+    SnapshotHeader header = {};
+    string image(sizeof(header), '\0');
+    header.tablesOffset = appendSection(&image, writer.tables);
+    header.namesOffset = appendSection(&image, writer.names);
+    header.fksOffset = appendSection(&image, writer.fks);
+    header.idxsOffset = appendSection(&image, writer.idxs);
+    header.rfsOffset = appendSection(&image, writer.rfs);
+    header.statsOffset = appendSection(&image, writer.stats);
+    header.valuesOffset = appendSection(&image, writer.values);
+    header.widthsOffset = appendSection(&image, writer.widths);
+    header.stringsOffset = image.size();
+    header.stringsSize = writer.strings.size();
+    image += writer.strings;
+
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.headerSize = sizeof(header);
+    header.fileSize = image.size();
+    header.ntables = writer.tables.size();
+    header.nnames = writer.names.size();
+    header.nfks = writer.fks.size();
+    header.nidxs = writer.idxs.size();
+    header.nrfs = writer.rfs.size();
+    header.nstats = writer.stats.size();
+    header.nvalues = writer.values.size();
+    header.nwidths = writer.widths.size();
+    header.checksum = fnv1a(image.data() + sizeof(header), image.size() - sizeof(header));
+    memcpy(&(image[0]), &header, sizeof(header));
+
+    ofstream out(fileName, ios::binary | ios::trunc);
+    out.write(image.data(), image.size());
+    out.close();
+    if (!out) {
+        cerr << "Could not write catalog snapshot " << fileName << endl;
+        return false;
+    }
+    return true;
+}
+
+// Returns whether a mapped file starts with the snapshot magic
+bool isSnapshot(const MappedFile& mapped) {
+    return mapped.size >= sizeof(SNAPSHOT_MAGIC) && memcmp(mapped.data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0;
+}
+
+// Read-only view of the records of a mapped snapshot
+class SnapshotView {
+    public:
+        const SnapshotHeader* header = NULL;
+        const SnapTable* tables = NULL;
+        const SnapString* names = NULL;
+        const SnapFK* fks = NULL;
+        const SnapIndex* idxs = NULL;
+        const SnapRF* rfs = NULL;
+        const SnapColumnStats* stats = NULL;
+        const double* values = NULL;
+        const SnapWidth* widths = NULL;
+        const char* strings = NULL;
+
+        bool validString(SnapString ref) const {
+            return (uint64_t)ref.offset + ref.length <= header->stringsSize;
+        }
+        string str(SnapString ref) const {
+            return string(strings + ref.offset, ref.length);
+        }
+        bool validTable(const SnapTable& rec) const {
+            return (uint64_t)rec.firstName + rec.ncolumns + rec.npks <= header->nnames &&
+                   (uint64_t)rec.firstFk + rec.nfks <= header->nfks &&
+                   (uint64_t)rec.firstIdx + rec.nidxs <= header->nidxs &&
+                   (uint64_t)rec.firstRf + rec.nrfs <= header->nrfs &&
+                   (uint64_t)rec.firstStat + rec.nstats <= header->nstats &&
+                   (uint64_t)rec.firstWidth + rec.nwidths <= header->nwidths;
+        }
+        // Checks the names, keys, foreign keys, indexes and RFs of a table whose ranges are valid
+        bool validStrings(const SnapTable& rec) const {
+            for (uint32_t i = 0; i < rec.ncolumns + rec.npks; i++) {
+                if (!validString(names[rec.firstName + i])) {
+                    return false;
+                }
+            }
+            for (uint32_t i = 0; i < rec.nfks; i++) {
+                const SnapFK& fk = fks[rec.firstFk + i];
+                if (!validString(fk.col) || !validString(fk.ref_table) || !validString(fk.ref_col)) {
+                    return false;
+                }
+            }
+            for (uint32_t i = 0; i < rec.nidxs; i++) {
+                if (!validString(idxs[rec.firstIdx + i].name)) {
+                    return false;
+                }
+            }
+            for (uint32_t i = 0; i < rec.nrfs; i++) {
+                if (!validString(rfs[rec.firstRf + i].colName)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        bool validStats(const SnapColumnStats& rec) const {
+            return validString(rec.colName) && (uint64_t)rec.firstValue + 2*(uint64_t)rec.nmcvs + 2*(uint64_t)rec.nbounds <= header->nvalues;
+        }
+};
+
+// Returns whether a section of count records fits inside the file at an aligned offset
+bool validSection(const MappedFile& mapped, uint64_t offset, uint64_t count, uint64_t recordSize) {
+    return offset % 8 == 0 && offset >= sizeof(SnapshotHeader) && offset <= mapped.size &&
+           count <= (mapped.size - offset) / recordSize;
+}
+
+// Checks the header, layout and checksum of a mapped snapshot and points a view at its sections
+bool openSnapshot(const MappedFile& mapped, SnapshotView* view, string* error) {
+    if (mapped.size < sizeof(SnapshotHeader)) {
+        *error = "truncated header";
+        return false;
+    }
+    const SnapshotHeader* header = (const SnapshotHeader*)mapped.data;
+    if (header->version != SNAPSHOT_VERSION || header->headerSize != sizeof(SnapshotHeader)) {
+        *error = "unsupported version " + to_string(header->version) + " (expected " + to_string(SNAPSHOT_VERSION) + ")";
+        return false;
+    }
+    if (header->fileSize != mapped.size ||
+        !validSection(mapped, header->tablesOffset, header->ntables, sizeof(SnapTable)) ||
+        !validSection(mapped, header->namesOffset, header->nnames, sizeof(SnapString)) ||
+        !validSection(mapped, header->fksOffset, header->nfks, sizeof(SnapFK)) ||
+        !validSection(mapped, header->idxsOffset, header->nidxs, sizeof(SnapIndex)) ||
+        !validSection(mapped, header->rfsOffset, header->nrfs, sizeof(SnapRF)) ||
+        !validSection(mapped, header->statsOffset, header->nstats, sizeof(SnapColumnStats)) ||
+        !validSection(mapped, header->valuesOffset, header->nvalues, sizeof(double)) ||
+        !validSection(mapped, header->widthsOffset, header->nwidths, sizeof(SnapWidth)) ||
+        header->stringsOffset > mapped.size || header->stringsSize > mapped.size - header->stringsOffset) {
+        *error = "corrupt section layout";
+        return false;
+    }
+    if (fnv1a(mapped.data + sizeof(SnapshotHeader), mapped.size - sizeof(SnapshotHeader)) != header->checksum) {
+        *error = "checksum mismatch";
+        return false;
+    }
+    view->header = header;
+    view->tables = (const SnapTable*)(mapped.data + header->tablesOffset);
+    view->names = (const SnapString*)(mapped.data + header->namesOffset);
+    view->fks = (const SnapFK*)(mapped.data + header->fksOffset);
+    view->idxs = (const SnapIndex*)(mapped.data + header->idxsOffset);
+    view->rfs = (const SnapRF*)(mapped.data + header->rfsOffset);
+    view->stats = (const SnapColumnStats*)(mapped.data + header->statsOffset);
+    view->values = (const double*)(mapped.data + header->valuesOffset);
+    view->widths = (const SnapWidth*)(mapped.data + header->widthsOffset);
+    view->strings = mapped.data + header->stringsOffset;
+    return true;
+}
+
+// Builds the catalog tables straight from the records of a mapped snapshot
+bool loadSnapshot(const MappedFile& mapped, const string& fileName) {
+    SnapshotView view;
+    string error;
+    if (!openSnapshot(mapped, &view, &error)) {
+        cerr << fileName << ": error: invalid catalog snapshot: " << error << endl;
+        return false;
+    }
+    catalog.tables.reserve(catalog.tables.size() + view.header->ntables);
+    catalog.tableIds.reserve(catalog.tableIds.size() + view.header->ntables);
+    columnIds.reserve(columnIds.size() + view.header->nnames);
+    for (uint32_t t = 0; t < view.header->ntables; t++) {
+        const SnapTable& rec = view.tables[t];
+        if (!view.validTable(rec) || !view.validString(rec.name) || !view.validStrings(rec)) {
+            cerr << fileName << ": error: invalid catalog snapshot: corrupt table record " << t << endl;
+            return false;
+        }
+        Table tbl;
+        tbl.setName(view.str(rec.name));
+        tbl.columns.reserve(rec.ncolumns);
+        for (uint32_t i = 0; i < rec.ncolumns; i++) {
+            tbl.addColumn(view.str(view.names[rec.firstName + i]));
+        }
+        for (uint32_t i = 0; i < rec.npks; i++) {
+            tbl.addPK(view.str(view.names[rec.firstName + rec.ncolumns + i]));
+        }
+        for (uint32_t i = 0; i < rec.nfks; i++) {
+            const SnapFK& fk = view.fks[rec.firstFk + i];
+            tbl.addFK({view.str(fk.col), view.str(fk.ref_table), view.str(fk.ref_col)});
+        }
+        for (uint32_t i = 0; i < rec.nidxs; i++) {
+            const SnapIndex& idxRec = view.idxs[rec.firstIdx + i];
+            Index idx;
+            idx.name = view.str(idxRec.name);
+            idx.nkeys = idxRec.nkeys;
+            idx.npages = idxRec.npages;
+            idx.height = idxRec.height;
+            idx.min = idxRec.min;
+            idx.max = idxRec.max;
+            tbl.addIndex(idx);
+        }
+        for (uint32_t i = 0; i < rec.nrfs; i++) {
+            RF rf;
+            rf.colName = view.str(view.rfs[rec.firstRf + i].colName);
+            rf.rfVal = view.rfs[rec.firstRf + i].rfVal;
+            tbl.addRF(rf);
+        }
+        for (uint32_t i = 0; i < rec.nstats; i++) {
+            const SnapColumnStats& statRec = view.stats[rec.firstStat + i];
+            if (!view.validStats(statRec)) {
+                cerr << fileName << ": error: invalid catalog snapshot: corrupt column statistics in table record " << t << endl;
+                return false;
+            }
+            const double* values = view.values + statRec.firstValue;
+            ColumnStats colStats;
+            colStats.colName = view.str(statRec.colName);
+            colStats.mcvValues.assign(values, values + statRec.nmcvs);
+            colStats.mcvCumFreqs.assign(values + statRec.nmcvs, values + 2*statRec.nmcvs);
+            colStats.bounds.assign(values + 2*statRec.nmcvs, values + 2*statRec.nmcvs + statRec.nbounds);
+            colStats.cumFreqs.assign(values + 2*statRec.nmcvs + statRec.nbounds, values + 2*statRec.nmcvs + 2*statRec.nbounds);
+            tbl.addColumnStats(colStats);
+        }
+        for (uint32_t i = 0; i < rec.nwidths; i++) {
+            const SnapWidth& widthRec = view.widths[rec.firstWidth + i];
+            if (!view.validString(widthRec.colName)) {
+                cerr << fileName << ": error: invalid catalog snapshot: corrupt column width in table record " << t << endl;
+                return false;
+            }
+            ColumnWidth width;
+            width.colName = view.str(widthRec.colName);
+            width.bytes = widthRec.bytes;
+            tbl.addWidth(width);
+        }
+        tbl.ntuples = rec.ntuples;
+        tbl.npages = rec.npages;
+        tbl.tuplesPerPage = rec.tuplesPerPage;
+        tbl.isOpTable = false;
+        catalog.addTable(move(tbl));
+    }
+    catalogVersion++;
+    return true;
+}
+
+// Loads the statements of a file through a memory mapping
+// Catalog snapshots are recognised by their magic and loaded from their records instead
+// With more than one parse thread the file is split at line boundaries, the chunks are parsed in
+// parallel and their statements are applied to the catalog in file order
+bool loadStatements(string fileName, bool catalogOnly) {
+    MappedFile mapped;
+    if (!mapped.open(fileName)) {
+        cerr << "Could not open input file " << fileName << endl;
+        return false;
+    }
+    if (isSnapshot(mapped)) {
+        return loadSnapshot(mapped, fileName);
+    }
+    string_view text(mapped.data, mapped.size);
+    if (parseThreads <= 1 || text.size() < MIN_PARSE_CHUNK) {
+        forEachLine(text, [&](string_view line, int lineNo) {
+            processLine(line, lineNo, fileName, cerr, catalogOnly);
+        });
+        return true;
+    }
+
+    // Cut the file into a few chunks per thread so applying can start before parsing is done
+    int nchunks = parseThreads * 4;
+    vector<ParsedChunk> chunks;
+    size_t start = 0;
+    for (int c = 1; c <= nchunks && start < text.size(); c++) {
+        size_t end = (c == nchunks) ? text.size() : max(start, text.size() * c / nchunks);
+        const char* newline = (const char*)memchr(text.data() + end, '\n', text.size() - end);
+        end = (newline != NULL) ? newline - text.data() + 1 : text.size();
+        ParsedChunk chunk;
+        chunk.text = text.substr(start, end - start);
+        chunks.push_back(move(chunk));
+        start = end;
+    }
+
+    vector<bool> parsed(chunks.size(), false);
+    mutex parsedLock;
+    condition_variable parsedReady;
+    WorkStealingPool pool(parseThreads);
+    pool.start(chunks.size(), [&](int c) {
+        parseChunk(&(chunks[c]), catalogOnly);
+        lock_guard<mutex> guard(parsedLock);
+        parsed[c] = true;
+        parsedReady.notify_one();
+    });
+    int lineOffset = 0;
+    for (unsigned int c = 0; c < chunks.size(); c++) {
+        {
+            unique_lock<mutex> guard(parsedLock);
+            parsedReady.wait(guard, [&]() { return (bool)parsed[c]; });
+        }
+        applyChunk(&(chunks[c]), lineOffset, fileName);
+        lineOffset += chunks[c].lines;
+        // Free each chunk's statements as soon as they are in the catalog
+        chunks[c].stmts = vector<Statement>();
+    }
+    pool.wait();
+    return true;
+}
+
+// Loads the catalog statements of a file, skipping any query statements in it
+bool loadCatalog(string fileName) {
+    if (!loadStatements(fileName, true)) {
+        return false;
+    }
+    updateRegTbls();
+    return true;
+}
+
+// ---------------- Execution ----------------
+// Directory with one column file per base table; when set the optimized plan is also run (--execute)
+string dataDir = "";
+// File the rows of executed queries are written to as CSV (--result)
+string resultFile = "";
+// Worker threads each executed query is spread over (--threads)
+int execThreads = max((int)thread::hardware_concurrency(), 1);
+
+const char COLUMN_FILE_MAGIC[8] = {'Q', 'O', 'C', 'O', 'L', 'S', '\0', '\0'};
+const uint32_t COLUMN_FILE_VERSION = 1;
+// Rows pushed from one operator to the next at a time, and rows of a table handed to a worker at a time
+const int BATCH_SIZE = 1024;
+const int MORSEL_ROWS = 16*BATCH_SIZE;
+
+// Header of a column file
+// The column names follow as length-prefixed strings, then each column is stored as nrows int32 values
+// starting at dataOffset, in the order of the names
+struct ColumnFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t ncolumns;
+    uint64_t nrows;
+    uint64_t dataOffset;
+};
+
+// Raised when a plan cannot be run over the data files
+class ExecError : public runtime_error {
+    public:
+        ExecError(string msg) : runtime_error(msg) {}
+};
+
+// Returns the path of the column file holding a base table
+string columnFilePath(const string& dir, const string& tableName) {
+    return dir + "/" + tableName + ".col";
+}
+
+// Writes the columns of a table to a column file
+bool writeColumnFile(const string& fileName, const vector<string>& names, const vector<vector<int32_t>>& columns, uint64_t nrows) {
+    ColumnFileHeader header = {};
+    string image(sizeof(header), '\0');
+    for (unsigned int i = 0; i < names.size(); i++) {
+        uint32_t length = names[i].size();
+        image.append((const char*)&length, sizeof(length));
+        image += names[i];
+    }
+    image.resize((image.size() + 7)/8*8, '\0');
+
+    memcpy(header.magic, COLUMN_FILE_MAGIC, sizeof(header.magic));
+    header.version = COLUMN_FILE_VERSION;
+    header.ncolumns = names.size();
+    header.nrows = nrows;
+    header.dataOffset = image.size();
+    memcpy(&(image[0]), &header, sizeof(header));
+
+    ofstream out(fileName, ios::binary | ios::trunc);
+    out.write(image.data(), image.size());
+    for (unsigned int i = 0; i < columns.size(); i++) {
+        out.write((const char*)columns[i].data(), nrows*sizeof(int32_t));
+    }
+    out.close();
+    if (!out) {
+        cerr << "Could not write column file " << fileName << endl;
+        return false;
+    }
+    return true;
+}
+
+// For reading a column file in place
+class ColumnFile {
+    public:
+        MappedFile file;
+        vector<string> names;
+        vector<const int32_t*> columns;
+        uint64_t nrows = 0;
+
+        // Maps the file and checks its layout, describing the first problem found in error
+        bool open(const string& fileName, string& error) {
+            if (!file.open(fileName)) {
+                error = "cannot open " + fileName;
+                return false;
+            }
+            ColumnFileHeader header;
+            if (file.size < sizeof(header)) {
+                error = fileName + " is too short";
+                return false;
+            }
+            memcpy(&header, file.data, sizeof(header));
+            if (memcmp(header.magic, COLUMN_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != COLUMN_FILE_VERSION) {
+                error = fileName + " is not a column file of this version";
+                return false;
+            }
+            size_t pos = sizeof(header);
+            for (unsigned int i = 0; i < header.ncolumns; i++) {
+                uint32_t length;
+                if (pos + sizeof(length) > file.size) {
+                    error = fileName + " has a truncated column list";
+                    return false;
+                }
+                memcpy(&length, file.data + pos, sizeof(length));
+                pos += sizeof(length);
+                if (length > file.size - pos) {
+                    error = fileName + " has a truncated column list";
+                    return false;
+                }
+                names.push_back(string(file.data + pos, length));
+                pos += length;
+            }
+            uint64_t maxRows = (file.size - min<uint64_t>(header.dataOffset, file.size))/sizeof(int32_t);
+            if (header.dataOffset < pos || header.dataOffset % sizeof(int32_t) != 0 ||
+                (header.ncolumns > 0 && header.nrows > maxRows/header.ncolumns)) {
+                error = fileName + " is truncated";
+                return false;
+            }
+            nrows = header.nrows;
+            for (unsigned int i = 0; i < header.ncolumns; i++) {
+                columns.push_back((const int32_t*)(file.data + header.dataOffset) + i*nrows);
+            }
+            return true;
+        }
+};
+
+// Draws a value from the distribution described by a histogram and MCV list
+int32_t drawFromStats(const ColumnStats& stats, mt19937& rng) {
+    double u = uniform_real_distribution<double>(0, 1)(rng);
+    if (!stats.mcvValues.empty() && u < stats.mcvCumFreqs.back()) {
+        int i = upper_bound(stats.mcvCumFreqs.begin(), stats.mcvCumFreqs.end(), u) - stats.mcvCumFreqs.begin();
+        return (int32_t)stats.mcvValues[min(i, (int)stats.mcvValues.size() - 1)];
+    }
+    if (stats.bounds.empty()) {
+        return (int32_t)stats.mcvValues.back();
+    }
+    // Invert the cumulative fractions, spreading values evenly inside a bucket
+    double v = uniform_real_distribution<double>(0, 1)(rng);
+    int i = upper_bound(stats.cumFreqs.begin(), stats.cumFreqs.end(), v) - stats.cumFreqs.begin();
+    i = max(1, min(i, (int)stats.bounds.size() - 1));
+    double low = stats.bounds[i - 1];
+    double high = stats.bounds[i];
+    return (int32_t)llround(low + (high - low)*uniform_real_distribution<double>(0, 1)(rng));
+}
+
+// Synthesizes one column of a base table from its statistics
+// A single-column primary key counts up from 1, foreign keys draw from the key range of the referenced
+// table, histograms and MCVs are sampled, index ranges are drawn uniformly and other columns get as many
+// distinct values as their reduction factor suggests
+vector<int32_t> generateColumn(Table* tbl, const string& column, mt19937& rng) {
+    vector<int32_t> values(tbl->ntuples);
+    if (tbl->pks.size() == 1 && tbl->pks[0] == column) {
+        for (int r = 0; r < tbl->ntuples; r++) {
+            values[r] = r + 1;
+        }
+        return values;
+    }
+    int low = 1;
+    int high = max(tbl->ntuples, 1);
+    for (unsigned int i = 0; i < tbl->fks.size(); i++) {
+        Table* ref = (tbl->fks[i].col == column) ? findTable(tbl->fks[i].ref_table) : nullptr;
+        if (ref != nullptr) {
+            high = max(ref->ntuples, 1);
+        }
+    }
+    ColumnStats* stats = findColumnStats(tbl, column);
+    Index* idx = findIndex(tbl, column);
+    RF* rf = findRF(tbl, column);
+    if (stats != nullptr && (!stats->bounds.empty() || !stats->mcvValues.empty())) {
+        for (int r = 0; r < tbl->ntuples; r++) {
+            values[r] = drawFromStats(*stats, rng);
+        }
+        return values;
+    }
+    if (high == max(tbl->ntuples, 1)) {
+        if (idx != nullptr && idx->max > idx->min) {
+            low = idx->min;
+            high = idx->max;
+        } else if (rf != nullptr && rf->rfVal > 0) {
+            high = max(1, (int)min(1/rf->rfVal, (double)INT_MAX));
+        }
+    }
+    uniform_int_distribution<int32_t> dist(low, high);
+    for (int r = 0; r < tbl->ntuples; r++) {
+        values[r] = dist(rng);
+    }
+    return values;
+}
+
+// Writes a column file for every base table in the catalog
+bool generateData(const string& dir) {
+    for (unsigned int i = 0; i < catalog.tables.size(); i++) {
+        Table* tbl = &(catalog.tables[i]);
+        if (tbl->isOpTable) {
+            continue;
+        }
+        // Seed per table so the data of a table does not depend on the rest of the catalog
+        mt19937 rng(hash<string>()(tbl->name) & 0xffffffff);
+        vector<vector<int32_t>> columns;
+        for (unsigned int c = 0; c < tbl->columns.size(); c++) {
+            columns.push_back(generateColumn(tbl, tbl->columns[c], rng));
+        }
+        if (!writeColumnFile(columnFilePath(dir, tbl->name), tbl->columns, columns, tbl->ntuples)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Instruction sets the execution kernels can use
+enum SimdLevel { SIMD_SCALAR, SIMD_SSE4, SIMD_AVX2 };
+const char* simdLevelNames[] = {"scalar", "sse4", "avx2"};
+
+// Returns the widest instruction set supported by the CPU we run on
+SimdLevel detectSimd() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        return SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("popcnt")) {
+        return SIMD_SSE4;
+    }
+#endif
+    return SIMD_SCALAR;
+}
+
+// Instruction set used by the kernels, can be lowered with --simd
+SimdLevel simdLevel = detectSimd();
+
+// Returns whether a value passes a selection comparison
+template <char Compare>
+inline bool passes(int32_t x, int32_t value) {
+    return (Compare == '=') ? (x == value) : (Compare == '!') ? (x != value) : (Compare == '<') ? (x < value) : (x > value);
+}
+
+// Scalar kernels; they always store a position and only advance past it on a match, so there is no branch
+template <char Compare>
+int filterDenseScalar(const int32_t* values, int count, int32_t value, uint32_t* sel) {
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        sel[n] = i;
+        n += passes<Compare>(values[i], value);
+    }
+    return n;
+}
+template <char Compare>
+int filterSparseScalar(const int32_t* values, const uint32_t* rows, int count, int32_t value, uint32_t* sel) {
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        sel[n] = rows[i];
+        n += passes<Compare>(values[rows[i]], value);
+    }
+    return n;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Lane orders that move the selected lanes of a comparison mask to the front, one per mask
+// For AVX2 these are permutevar8x32 indices, for SSE4 pshufb byte shuffles
+struct CompressTables {
+    uint32_t lanes8[256][8];
+    uint8_t lanes4[16][16];
+
+    CompressTables() {
+        for (int mask = 0; mask < 256; mask++) {
+            int n = 0;
+            for (int lane = 0; lane < 8; lane++) {
+                if (mask & (1 << lane)) {
+                    lanes8[mask][n++] = lane;
+                }
+            }
+            while (n < 8) {
+                lanes8[mask][n++] = 0;
+            }
+        }
+        for (int mask = 0; mask < 16; mask++) {
+            int n = 0;
+            for (int lane = 0; lane < 4; lane++) {
+                if (mask & (1 << lane)) {
+                    for (int b = 0; b < 4; b++) {
+                        lanes4[mask][n*4 + b] = lane*4 + b;
+                    }
+                    n++;
+                }
+            }
+            for (; n < 4; n++) {
+                for (int b = 0; b < 4; b++) {
+                    lanes4[mask][n*4 + b] = 0x80;
+                }
+            }
+        }
+    }
+};
+CompressTables compressTables;
+
+template <char Compare>
+__attribute__((target("avx2"))) inline __m256i compare8(__m256i x, __m256i value) {
+    if (Compare == '=') {
+        return _mm256_cmpeq_epi32(x, value);
+    }
+    if (Compare == '!') {
+        return _mm256_xor_si256(_mm256_cmpeq_epi32(x, value), _mm256_set1_epi32(-1));
+    }
+    return (Compare == '<') ? _mm256_cmpgt_epi32(value, x) : _mm256_cmpgt_epi32(x, value);
+}
+template <char Compare>
+__attribute__((target("sse4.1"))) inline __m128i compare4(__m128i x, __m128i value) {
+    if (Compare == '=') {
+        return _mm_cmpeq_epi32(x, value);
+    }
+    if (Compare == '!') {
+        return _mm_xor_si128(_mm_cmpeq_epi32(x, value), _mm_set1_epi32(-1));
+    }
+    return (Compare == '<') ? _mm_cmpgt_epi32(value, x) : _mm_cmpgt_epi32(x, value);
+}
+
+// AVX2 kernels compare 8 values at a time and compress the passing positions with a lane permutation
+// The full 8-lane store stays inside sel because no more positions have been written than were read
+template <char Compare>
+__attribute__((target("avx2,popcnt"))) int filterDenseAvx2(const int32_t* values, int count, int32_t value, uint32_t* sel) {
+    __m256i v = _mm256_set1_epi32(value);
+    __m256i positions = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i step = _mm256_set1_epi32(8);
+    int n = 0;
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(values + i));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(compare8<Compare>(x, v)));
+        __m256i order = _mm256_loadu_si256((const __m256i*)compressTables.lanes8[mask]);
+        _mm256_storeu_si256((__m256i*)(sel + n), _mm256_permutevar8x32_epi32(positions, order));
+        n += _mm_popcnt_u32(mask);
+        positions = _mm256_add_epi32(positions, step);
+    }
+    for (; i < count; i++) {
+        sel[n] = i;
+        n += passes<Compare>(values[i], value);
+    }
+    return n;
+}
+template <char Compare>
+__attribute__((target("avx2,popcnt"))) int filterSparseAvx2(const int32_t* values, const uint32_t* rows, int count, int32_t value,
+                                                             uint32_t* sel) {
+    __m256i v = _mm256_set1_epi32(value);
+    int n = 0;
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i positions = _mm256_loadu_si256((const __m256i*)(rows + i));
+        __m256i x = _mm256_i32gather_epi32((const int*)values, positions, 4);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(compare8<Compare>(x, v)));
+        __m256i order = _mm256_loadu_si256((const __m256i*)compressTables.lanes8[mask]);
+        _mm256_storeu_si256((__m256i*)(sel + n), _mm256_permutevar8x32_epi32(positions, order));
+        n += _mm_popcnt_u32(mask);
+    }
+    return n + filterSparseScalar<Compare>(values, rows + i, count - i, value, sel + n);
+}
+__attribute__((target("avx2"))) void gatherAvx2(const int32_t* values, const uint32_t* rows, int count, int32_t* out) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i positions = _mm256_loadu_si256((const __m256i*)(rows + i));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_i32gather_epi32((const int*)values, positions, 4));
+    }
+    for (; i < count; i++) {
+        out[i] = values[rows[i]];
+    }
+}
+
+// SSE4 has no gather, so only the dense kernel is vectorized
+template <char Compare>
+__attribute__((target("sse4.1,popcnt"))) int filterDenseSse4(const int32_t* values, int count, int32_t value, uint32_t* sel) {
+    __m128i v = _mm_set1_epi32(value);
+    __m128i positions = _mm_setr_epi32(0, 1, 2, 3);
+    __m128i step = _mm_set1_epi32(4);
+    int n = 0;
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(values + i));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(compare4<Compare>(x, v)));
+        __m128i order = _mm_loadu_si128((const __m128i*)compressTables.lanes4[mask]);
+        _mm_storeu_si128((__m128i*)(sel + n), _mm_shuffle_epi8(positions, order));
+        n += _mm_popcnt_u32(mask);
+        positions = _mm_add_epi32(positions, step);
+    }
+    for (; i < count; i++) {
+        sel[n] = i;
+        n += passes<Compare>(values[i], value);
+    }
+    return n;
+}
+#endif
+
+// Runs the widest filter kernel available for one comparison
+template <char Compare>
+int filterWith(const int32_t* values, const uint32_t* rows, int count, int32_t value, uint32_t* sel) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (simdLevel == SIMD_AVX2) {
+        return (rows == NULL) ? filterDenseAvx2<Compare>(values, count, value, sel)
+                              : filterSparseAvx2<Compare>(values, rows, count, value, sel);
+    }
+    if (simdLevel == SIMD_SSE4 && rows == NULL) {
+        return filterDenseSse4<Compare>(values, count, value, sel);
+    }
+#endif
+    return (rows == NULL) ? filterDenseScalar<Compare>(values, count, value, sel)
+                          : filterSparseScalar<Compare>(values, rows, count, value, sel);
+}
+
+// Writes the positions of the values passing a comparison to sel and returns how many pass
+// rows lists the candidate positions, or is NULL when all count values are candidates. sel needs room for
+// count positions and may not overlap rows
+int filterValues(const int32_t* values, const uint32_t* rows, int count, char compare, int32_t value, uint32_t* sel) {
+    if (compare == '=') {
+        return filterWith<'='>(values, rows, count, value, sel);
+    }
+    if (compare == '!') {
+        return filterWith<'!'>(values, rows, count, value, sel);
+    }
+    if (compare == '<') {
+        return filterWith<'<'>(values, rows, count, value, sel);
+    }
+    return filterWith<'>'>(values, rows, count, value, sel);
+}
+
+// Writes the positions of the values found in a sorted list to sel and returns how many there are
+// rows lists the candidate positions, or is NULL when all count values are candidates
+int filterInList(const int32_t* values, const uint32_t* rows, int count, const vector<int32_t>& list, uint32_t* sel) {
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        uint32_t r = (rows != NULL) ? rows[i] : i;
+        sel[n] = r;
+        n += binary_search(list.begin(), list.end(), values[r]);
+    }
+    return n;
+}
+
+// For storing a selection predicate as the filter kernel passes that evaluate it
+// Ranges become one or two comparisons with = < > or ! (not equal), and an IN-list is looked up on its own
+struct FilterPlan {
+    vector<pair<char, int32_t>> compares;
+    bool hasList = false;
+    vector<int32_t> list;
+};
+
+// Works out the kernel passes of a selection; values are integers, so x >= v is x > v - 1
+FilterPlan planFilter(const Operation* sel) {
+    FilterPlan plan;
+    long long v = sel->sel_val;
+    long long lo = INT_MIN;
+    long long hi = INT_MAX;
+    if (sel->sel_type == "=" || sel->sel_type == "<>") {
+        plan.compares.push_back(make_pair((sel->sel_type == "=") ? '=' : '!', (int32_t)v));
+        return plan;
+    } else if (sel->sel_type == "IN") {
+        plan.hasList = true;
+        plan.list.assign(sel->sel_list.begin(), sel->sel_list.end());
+        return plan;
+    } else if (sel->sel_type == ">" || sel->sel_type == ">=") {
+        lo = (sel->sel_type == ">") ? v + 1 : v;
+    } else if (sel->sel_type == "<" || sel->sel_type == "<=") {
+        hi = (sel->sel_type == "<") ? v - 1 : v;
+    } else if (sel->sel_type == "BETWEEN") {
+        lo = v;
+        hi = sel->sel_hi;
+    }
+    if (lo > hi) {
+        // Nothing passes an empty range, and a list with no values expresses that
+        plan.hasList = true;
+    } else if (lo == hi) {
+        plan.compares.push_back(make_pair('=', (int32_t)lo));
+    } else {
+        if (lo > INT_MIN) {
+            plan.compares.push_back(make_pair('>', (int32_t)(lo - 1)));
+        }
+        if (hi < INT_MAX) {
+            plan.compares.push_back(make_pair('<', (int32_t)(hi + 1)));
+        }
+    }
+    return plan;
+}
+
+// Runs the passes of a filter plan over the candidate positions in rows (NULL for all count values), leaving
+// the positions that pass in sel and returning how many there are. spare is scratch space for count positions;
+// neither may overlap rows
+int runFilter(const FilterPlan& plan, const int32_t* values, const uint32_t* rows, int count, uint32_t* sel, uint32_t* spare) {
+    int passes = plan.compares.size() + (plan.hasList ? 1 : 0);
+    if (passes == 0) {
+        for (int i = 0; i < count; i++) {
+            sel[i] = (rows != NULL) ? rows[i] : i;
+        }
+        return count;
+    }
+    // Alternate between the two buffers so the last pass writes to sel
+    const uint32_t* in = rows;
+    for (int p = 0; p < passes; p++) {
+        uint32_t* out = ((passes - 1 - p) % 2 == 0) ? sel : spare;
+        if (p < (int)plan.compares.size()) {
+            count = filterValues(values, in, count, plan.compares[p].first, plan.compares[p].second, out);
+        } else {
+            count = filterInList(values, in, count, plan.list, out);
+        }
+        in = out;
+    }
+    return count;
+}
+
+// Copies the values at the given positions to out
+void gatherValues(const int32_t* values, const uint32_t* rows, int count, int32_t* out) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (simdLevel == SIMD_AVX2) {
+        gatherAvx2(values, rows, count, out);
+        return;
+    }
+#endif
+    for (int i = 0; i < count; i++) {
+        out[i] = values[rows[i]];
+    }
+}
+
+// Bloom filter over the keys of a semi-join reduction
+// A key sets four bits of a single 64-bit word, so testing a value touches one cache line
+class BloomFilter {
+    public:
+        vector<uint64_t> words;
+        int bits = 0;
+
+        // Sizes the filter for about 16 bits per key
+        void init(size_t nkeys) {
+            bits = 0;
+            while (bits < 26 && ((size_t)64 << bits) < nkeys*16) {
+                bits++;
+            }
+            words.assign((size_t)1 << bits, 0);
+        }
+        static uint64_t hashKey(int32_t key) {
+            uint64_t h = (uint32_t)key;
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ULL;
+            h ^= h >> 33;
+            return h;
+        }
+        static uint64_t mask(uint64_t h) {
+            return (1ULL << (h & 63)) | (1ULL << ((h >> 6) & 63)) | (1ULL << ((h >> 12) & 63)) | (1ULL << ((h >> 18) & 63));
+        }
+        size_t word(uint64_t h) const {
+            return (bits > 0) ? h >> (64 - bits) : 0;
+        }
+        void add(int32_t key) {
+            uint64_t h = hashKey(key);
+            words[word(h)] |= mask(h);
+        }
+        bool mayContain(int32_t key) const {
+            uint64_t h = hashKey(key);
+            uint64_t m = mask(h);
+            return (words[word(h)] & m) == m;
+        }
+};
+
+// Writes the positions of the values a bloom filter may contain to sel and returns how many there are
+// rows lists the candidate positions, or is NULL when all count values are candidates; sel may be rows
+int filterBloom(const int32_t* values, const uint32_t* rows, int count, const BloomFilter& bloom, uint32_t* sel) {
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        uint32_t r = (rows != NULL) ? rows[i] : i;
+        sel[n] = r;
+        n += bloom.mayContain(values[r]);
+    }
+    return n;
+}
+
+// For passing a slice of rows between operators
+// Columns follow the schema of the producing operator. When sel is set, only the nsel rows it lists qualify;
+// it points into a buffer owned by the operator that filtered the batch
+struct Batch {
+    int count = 0;
+    vector<const int32_t*> cols;
+    const uint32_t* sel = NULL;
+    int nsel = 0;
+
+    int size() const {
+        return (sel != NULL) ? nsel : count;
+    }
+    uint32_t row(int i) const {
+        return (sel != NULL) ? sel[i] : i;
+    }
+};
+
+// Base class of the operators a plan is run with
+// Operators push batches to their consumer as soon as they have them. Inputs are numbered left to right;
+// the pipelines feeding input 1 of a join (its build side) run to completion before those feeding input 0.
+// Each worker thread has its own copy of every operator, so operators need no locking
+class ExecOperator {
+    public:
+        Node* node = NULL;
+        vector<int> schema;
+        vector<ExecOperator*> inputs;
+        ExecOperator* consumer = NULL;
+        int side = 0;
+        long rows = 0;
+
+        virtual ~ExecOperator() {}
+        // Receives a batch from input number from
+        virtual void consume(Batch& batch, int from) = 0;
+        // Called once input number from has delivered all the rows of this copy
+        virtual void finish(int from) {
+            consumer->finish(side);
+        }
+        void emit(Batch& batch) {
+            rows += batch.size();
+            consumer->consume(batch, side);
+        }
+        // Returns the position of a column in the output, or -1 if it is not there
+        int position(const string& colName) {
+            int id = lookupColumn(colName);
+            for (unsigned int i = 0; i < schema.size(); i++) {
+                if (schema[i] == id) {
+                    return i;
+                }
+            }
+            return -1;
+        }
+};
+
+// Reads a base table from its column file in batches
+// Semi-join reductions drop the rows whose join column misses their bloom filter before the batch is pushed
+class ScanOperator : public ExecOperator {
+    public:
+        ColumnFile* file;
+        Batch batch;
+        // Column position -> bloom filter its values have to pass
+        vector<pair<int, const BloomFilter*>> blooms;
+        vector<uint32_t> sel;
+
+        void consume(Batch& batch, int from) {}
+        // Pushes rows first..last-1 of the table through the pipeline
+        void scan(uint64_t first, uint64_t last) {
+            batch.cols.resize(file->columns.size());
+            sel.resize(BATCH_SIZE);
+            for (uint64_t start = first; start < last; start += BATCH_SIZE) {
+                batch.count = min<uint64_t>(BATCH_SIZE, last - start);
+                for (unsigned int c = 0; c < batch.cols.size(); c++) {
+                    batch.cols[c] = file->columns[c] + start;
+                }
+                batch.sel = NULL;
+                for (unsigned int i = 0; i < blooms.size() && batch.size() > 0; i++) {
+                    batch.nsel = filterBloom(batch.cols[blooms[i].first], batch.sel, batch.size(), *blooms[i].second, sel.data());
+                    batch.sel = sel.data();
+                }
+                if (batch.size() > 0) {
+                    emit(batch);
+                }
+            }
+        }
+};
+
+// Keeps the rows that satisfy a selection by narrowing the selection vector with a filter kernel
+class SelectOperator : public ExecOperator {
+    public:
+        int col;
+        FilterPlan filter;
+        vector<uint32_t> sel;
+        vector<uint32_t> spare;
+        Batch out;
+
+        void consume(Batch& batch, int from) {
+            sel.resize(BATCH_SIZE);
+            spare.resize(BATCH_SIZE);
+            out.count = batch.count;
+            out.cols = batch.cols;
+            out.sel = sel.data();
+            out.nsel = runFilter(filter, batch.cols[col], batch.sel, batch.size(), sel.data(), spare.data());
+            if (out.nsel > 0) {
+                emit(out);
+            }
+        }
+};
+
+// Keeps the columns of a projection
+// Unfiltered batches pass their column pointers on; filtered ones have the kept columns gathered into dense
+// vectors so that the operators above work on contiguous values
+class ProjectOperator : public ExecOperator {
+    public:
+        vector<int> positions;
+        vector<vector<int32_t>> dense;
+        Batch out;
+
+        void consume(Batch& batch, int from) {
+            out.cols.resize(positions.size());
+            if (batch.sel == NULL) {
+                out.count = batch.count;
+                for (unsigned int i = 0; i < positions.size(); i++) {
+                    out.cols[i] = batch.cols[positions[i]];
+                }
+            } else {
+                out.count = batch.nsel;
+                dense.resize(positions.size());
+                for (unsigned int i = 0; i < positions.size(); i++) {
+                    dense[i].resize(BATCH_SIZE);
+                    gatherValues(batch.cols[positions[i]], batch.sel, batch.nsel, dense[i].data());
+                    out.cols[i] = dense[i].data();
+                }
+            }
+            emit(out);
+        }
+};
+
+// Probe rows buffered before they are radix-partitioned, and rows probed per prefetch group
+const int PROBE_CHUNK = 16*BATCH_SIZE;
+const int PREFETCH_GROUP = 64;
+// Upper bound on the partitioning fan-out, beyond it the partitioning pass itself misses the TLB
+const int MAX_RADIX_BITS = 12;
+
+// Returns the size of the L2 cache, assuming 256KB when the system does not say
+size_t detectL2Cache() {
+    long bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    return (bytes > 0) ? bytes : 256*1024;
+}
+size_t l2CacheBytes = detectL2Cache();
+
+// Flat open-addressing hash table on an integer key, split into radix partitions
+// Keys are partitioned on the top bits of their hash so that the table of one partition fits in half of L2,
+// and each partition is a power-of-two run of slots at most half full probed linearly. Every build row gets
+// its own slot, so duplicate keys need no chains and nothing is allocated per entry
+class RadixHashTable {
+    public:
+        struct Slot {
+            int32_t key;
+            uint32_t row;
+        };
+        static const uint32_t EMPTY = UINT32_MAX;
+
+        int radixBits = 0;
+        vector<Slot> slots;
+        vector<uint32_t> partitionStart;
+        vector<uint32_t> partitionMask;
+
+        static uint32_t hashKey(int32_t key) {
+            uint32_t h = key;
+            h ^= h >> 16;
+            h *= 0x85ebca6b;
+            h ^= h >> 13;
+            h *= 0xc2b2ae35;
+            h ^= h >> 16;
+            return h;
+        }
+        uint32_t partitionOf(uint32_t hash) const {
+            return (radixBits > 0) ? hash >> (32 - radixBits) : 0;
+        }
+        const Slot* home(uint32_t hash) const {
+            uint32_t p = partitionOf(hash);
+            return &(slots[partitionStart[p] + (hash & partitionMask[p])]);
+        }
+
+        // Fills the table from the build keys and returns the build rows in partition order
+        // Slots refer to positions in that order, so the build columns have to be permuted the same way
+        vector<uint32_t> build(const vector<int32_t>& keys, int nthreads) {
+            uint32_t n = keys.size();
+            radixBits = 0;
+            while (radixBits < MAX_RADIX_BITS && ((uint64_t)n*2*sizeof(Slot) >> radixBits) > l2CacheBytes/2) {
+                radixBits++;
+            }
+            uint32_t npartitions = 1 << radixBits;
+
+            // Histogram the partitions, then scatter the rows so each partition is inserted while it is cached
+            vector<uint32_t> hashes(n);
+            vector<uint32_t> offsets(npartitions + 1, 0);
+            for (uint32_t r = 0; r < n; r++) {
+                hashes[r] = hashKey(keys[r]);
+                offsets[partitionOf(hashes[r]) + 1]++;
+            }
+            partitionStart.assign(npartitions + 1, 0);
+            partitionMask.assign(npartitions, 0);
+            for (uint32_t p = 0; p < npartitions; p++) {
+                uint32_t capacity = 2;
+                while (capacity < offsets[p + 1]*2) {
+                    capacity *= 2;
+                }
+                partitionMask[p] = capacity - 1;
+                partitionStart[p + 1] = partitionStart[p] + capacity;
+                offsets[p + 1] += offsets[p];
+            }
+            vector<uint32_t> order(n);
+            vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+            for (uint32_t r = 0; r < n; r++) {
+                order[next[partitionOf(hashes[r])]++] = r;
+            }
+
+            // Partitions own disjoint slots, so they are filled in parallel
+            slots.assign(partitionStart[npartitions], Slot{0, EMPTY});
+            WorkStealingPool pool(min<uint32_t>(nthreads, npartitions));
+            pool.start(npartitions, [&](int p) {
+                Slot* base = &(slots[partitionStart[p]]);
+                for (uint32_t i = offsets[p]; i < offsets[p + 1]; i++) {
+                    uint32_t r = order[i];
+                    uint32_t s = hashes[r] & partitionMask[p];
+                    while (base[s].row != EMPTY) {
+                        s = (s + 1) & partitionMask[p];
+                    }
+                    base[s] = Slot{keys[r], i};
+                }
+            });
+            pool.wait();
+            return order;
+        }
+
+        // Calls match with every build row holding key
+        template <typename Match>
+        void probe(int32_t key, uint32_t hash, Match match) const {
+            uint32_t p = partitionOf(hash);
+            const Slot* base = &(slots[partitionStart[p]]);
+            for (uint32_t s = hash & partitionMask[p]; base[s].row != EMPTY; s = (s + 1) & partitionMask[p]) {
+                if (base[s].key == key) {
+                    match(base[s].row);
+                }
+            }
+        }
+};
+
+// Build side of a hash join, shared read-only by the copies of the join once it is built
+struct JoinTable {
+    vector<vector<int32_t>> build;
+    RadixHashTable table;
+};
+
+// Joins its inputs by hashing input 1 on its join column and probing with input 0
+// Without join columns every pair of rows matches. Output rows are the probe columns then the build columns.
+// When the table needs more than one partition, probe rows are buffered into chunks and radix-partitioned the
+// same way so that each partition of the table is probed while it is in L2
+class HashJoinOperator : public ExecOperator {
+    public:
+        int probeCol = -1;
+        int buildCol = -1;
+        JoinTable* shared = NULL;
+        vector<vector<int32_t>> local;
+        vector<vector<int32_t>> chunk;
+        int chunkRows = 0;
+        vector<uint32_t> positions;
+        vector<uint32_t> hashes;
+        vector<uint32_t> matchProbe;
+        vector<uint32_t> matchBuild;
+        int nmatches = 0;
+        vector<vector<int32_t>> outCols;
+        Batch out;
+
+        void consume(Batch& batch, int from) {
+            if (from == 1) {
+                local.resize(batch.cols.size());
+                for (unsigned int c = 0; c < batch.cols.size(); c++) {
+                    copyRows(batch, c, &(local[c]));
+                }
+                return;
+            }
+            const vector<vector<int32_t>>& build = shared->build;
+            if (probeCol < 0) {
+                uint32_t nbuild = build.empty() ? 0 : build[0].size();
+                for (int i = 0; i < batch.size(); i++) {
+                    for (uint32_t b = 0; b < nbuild; b++) {
+                        addMatch(batch.cols.data(), batch.row(i), b);
+                    }
+                }
+                emitMatches(batch.cols.data());
+                return;
+            }
+            if (shared->table.radixBits == 0) {
+                const uint32_t* rows = batch.sel;
+                if (rows == NULL) {
+                    positions.resize(batch.count);
+                    for (int i = 0; i < batch.count; i++) {
+                        positions[i] = i;
+                    }
+                    rows = positions.data();
+                }
+                probeRows(batch.cols.data(), rows, batch.size());
+                return;
+            }
+            chunk.resize(batch.cols.size());
+            for (unsigned int c = 0; c < batch.cols.size(); c++) {
+                copyRows(batch, c, &(chunk[c]));
+            }
+            chunkRows += batch.size();
+            if (chunkRows >= PROBE_CHUNK) {
+                probeChunk();
+            }
+        }
+        void finish(int from) {
+            // The table is built from the rows of all the copies by buildJoinTable
+            if (from == 1) {
+                return;
+            }
+            probeChunk();
+            consumer->finish(side);
+        }
+        // Appends the qualifying values of one column of a batch to a vector
+        void copyRows(const Batch& batch, int c, vector<int32_t>* values) {
+            size_t start = values->size();
+            values->resize(start + batch.size());
+            if (batch.sel == NULL) {
+                memcpy(values->data() + start, batch.cols[c], batch.count*sizeof(int32_t));
+            } else {
+                gatherValues(batch.cols[c], batch.sel, batch.nsel, values->data() + start);
+            }
+        }
+        // Radix-partitions the buffered probe rows and probes them one partition at a time
+        void probeChunk() {
+            if (chunkRows == 0) {
+                return;
+            }
+            const RadixHashTable& table = shared->table;
+            uint32_t npartitions = 1 << table.radixBits;
+            vector<uint32_t> offsets(npartitions + 1, 0);
+            hashes.resize(chunkRows);
+            const int32_t* keys = chunk[probeCol].data();
+            for (int i = 0; i < chunkRows; i++) {
+                hashes[i] = RadixHashTable::hashKey(keys[i]);
+                offsets[table.partitionOf(hashes[i]) + 1]++;
+            }
+            for (uint32_t p = 0; p < npartitions; p++) {
+                offsets[p + 1] += offsets[p];
+            }
+            positions.resize(chunkRows);
+            for (int i = 0; i < chunkRows; i++) {
+                positions[offsets[table.partitionOf(hashes[i])]++] = i;
+            }
+            vector<const int32_t*> cols(chunk.size());
+            for (unsigned int c = 0; c < chunk.size(); c++) {
+                cols[c] = chunk[c].data();
+            }
+            // The scatter advanced every offset to the end of its partition, so the rows are already in order
+            probeRows(cols.data(), positions.data(), chunkRows);
+            chunkRows = 0;
+            for (unsigned int c = 0; c < chunk.size(); c++) {
+                chunk[c].clear();
+            }
+        }
+        // Probes rows in groups: hash and prefetch the home slots of a group, then look them up
+        void probeRows(const int32_t* const* cols, const uint32_t* rows, int count) {
+            const RadixHashTable& table = shared->table;
+            uint32_t groupHashes[PREFETCH_GROUP];
+            const int32_t* keys = cols[probeCol];
+            for (int start = 0; start < count; start += PREFETCH_GROUP) {
+                int n = min(PREFETCH_GROUP, count - start);
+                for (int i = 0; i < n; i++) {
+                    groupHashes[i] = RadixHashTable::hashKey(keys[rows[start + i]]);
+                    __builtin_prefetch(table.home(groupHashes[i]));
+                }
+                for (int i = 0; i < n; i++) {
+                    uint32_t r = rows[start + i];
+                    table.probe(keys[r], groupHashes[i], [&](uint32_t b) { addMatch(cols, r, b); });
+                }
+            }
+            emitMatches(cols);
+        }
+        // Records a matching pair of rows, emitting a batch once there are enough
+        void addMatch(const int32_t* const* cols, uint32_t r, uint32_t b) {
+            if (nmatches == 0) {
+                matchProbe.resize(BATCH_SIZE);
+                matchBuild.resize(BATCH_SIZE);
+            }
+            matchProbe[nmatches] = r;
+            matchBuild[nmatches] = b;
+            if (++nmatches == BATCH_SIZE) {
+                emitMatches(cols);
+            }
+        }
+        // Gathers the columns of the recorded matches into an output batch; cols must still be valid
+        void emitMatches(const int32_t* const* cols) {
+            if (nmatches == 0) {
+                return;
+            }
+            const vector<vector<int32_t>>& build = shared->build;
+            int nprobe = schema.size() - build.size();
+            outCols.resize(schema.size());
+            out.cols.resize(schema.size());
+            for (unsigned int c = 0; c < schema.size(); c++) {
+                outCols[c].resize(BATCH_SIZE);
+                if ((int)c < nprobe) {
+                    gatherValues(cols[c], matchProbe.data(), nmatches, outCols[c].data());
+                } else {
+                    gatherValues(build[c - nprobe].data(), matchBuild.data(), nmatches, outCols[c].data());
+                }
+                out.cols[c] = outCols[c].data();
+            }
+            out.count = nmatches;
+            nmatches = 0;
+            emit(out);
+        }
+};
+
+// Bytes in a page of the execution engine; sorts keep their buffers within bufferPages of them
+const int EXEC_PAGE_BYTES = 4096;
+
+// For a temp file sorted runs are spilled to
+// The file is unlinked as soon as it is created, so it goes away with the descriptor
+class TempFile {
+    public:
+        int fd = -1;
+        uint64_t size = 0;
+
+        TempFile() {}
+        TempFile(const TempFile&) = delete;
+        TempFile& operator=(const TempFile&) = delete;
+        ~TempFile() {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+
+        // Appends bytes at the end of the file, creating it on first use
+        bool append(const void* data, size_t bytes) {
+            if (fd < 0) {
+                const char* dir = getenv("TMPDIR");
+                string path = string((dir != NULL && dir[0] != '\0') ? dir : "/tmp") + "/qo-sort-XXXXXX";
+                fd = mkstemp(&(path[0]));
+                if (fd < 0) {
+                    return false;
+                }
+                unlink(path.c_str());
+            }
+            size_t done = 0;
+            while (done < bytes) {
+                ssize_t n = pwrite(fd, (const char*)data + done, bytes - done, size + done);
+                if (n <= 0) {
+                    return false;
+                }
+                done += n;
+            }
+            size += bytes;
+            return true;
+        }
+};
+
+// For a sorted run of records, each ncols values long, stored in a temp file or kept in memory
+struct SortRun {
+    TempFile* file = NULL;
+    uint64_t offset = 0;
+    uint64_t nrecords = 0;
+    const int32_t* memory = NULL;
+};
+
+// Reads blocks of spilled runs on a background thread so merges rarely wait for the disk
+class ReadAheadThread {
+    public:
+        ReadAheadThread() {
+            worker = thread([this]() { serve(); });
+        }
+        ReadAheadThread(const ReadAheadThread&) = delete;
+        ReadAheadThread& operator=(const ReadAheadThread&) = delete;
+        // Requests that are still queued are served before the thread stops
+        ~ReadAheadThread() {
+            {
+                lock_guard<mutex> guard(lock);
+                stopping = true;
+            }
+            wake.notify_one();
+            worker.join();
+        }
+
+        // Queues a read of bytes at offset into dest; the future tells whether it succeeded
+        future<bool> read(int fd, uint64_t offset, size_t bytes, void* dest) {
+            Request request;
+            request.fd = fd;
+            request.offset = offset;
+            request.bytes = bytes;
+            request.dest = dest;
+            future<bool> done = request.done.get_future();
+            {
+                lock_guard<mutex> guard(lock);
+                requests.push_back(move(request));
+            }
+            wake.notify_one();
+            return done;
+        }
+
+    private:
+        struct Request {
+            int fd;
+            uint64_t offset;
+            size_t bytes;
+            void* dest;
+            promise<bool> done;
+        };
+        mutex lock;
+        condition_variable wake;
+        deque<Request> requests;
+        bool stopping = false;
+        thread worker;
+
+        void serve() {
+            while (true) {
+                unique_lock<mutex> guard(lock);
+                wake.wait(guard, [this]() { return stopping || !requests.empty(); });
+                if (requests.empty()) {
+                    return;
+                }
+                Request request = move(requests.front());
+                requests.pop_front();
+                guard.unlock();
+                size_t done = 0;
+                while (done < request.bytes) {
+                    ssize_t n = pread(request.fd, (char*)request.dest + done, request.bytes - done, request.offset + done);
+                    if (n <= 0) {
+                        break;
+                    }
+                    done += n;
+                }
+                request.done.set_value(done == request.bytes);
+            }
+        }
+};
+
+// Reads a run record by record
+// Spilled runs are read in blocks through two buffers: while the first is consumed the next block is read
+// into the second
+class RunReader {
+    public:
+        SortRun run;
+        int ncols = 0;
+        size_t blockRecords = 0;
+        ReadAheadThread* io = NULL;
+        vector<int32_t> buffers[2];
+        uint64_t requested = 0;
+        size_t pos = 0;
+        size_t count = 0;
+        size_t pendingCount = 0;
+        future<bool> pending;
+
+        void open(const SortRun& source, int columns, size_t block, ReadAheadThread* reader) {
+            run = source;
+            ncols = columns;
+            blockRecords = max<size_t>(block, 1);
+            io = reader;
+            if (run.memory != NULL) {
+                count = run.nrecords;
+                return;
+            }
+            buffers[0].resize(blockRecords*ncols);
+            buffers[1].resize(blockRecords*ncols);
+            requestBlock();
+            nextBlock();
+        }
+        // Returns the current record, or NULL once the run is exhausted
+        const int32_t* current() const {
+            if (pos >= count) {
+                return NULL;
+            }
+            return ((run.memory != NULL) ? run.memory : buffers[0].data()) + pos*ncols;
+        }
+        void advance() {
+            if (++pos == count && run.memory == NULL) {
+                nextBlock();
+            }
+        }
+
+    private:
+        // Starts reading the next block of the run into the second buffer
+        void requestBlock() {
+            pendingCount = min<uint64_t>(blockRecords, run.nrecords - requested);
+            if (pendingCount > 0) {
+                size_t bytes = pendingCount*ncols*sizeof(int32_t);
+                pending = io->read(run.file->fd, run.offset + requested*ncols*sizeof(int32_t), bytes, buffers[1].data());
+                requested += pendingCount;
+            }
+        }
+        // Waits for the block read ahead, makes it current and starts reading the one after it
+        void nextBlock() {
+            pos = 0;
+            count = pendingCount;
+            if (count == 0) {
+                return;
+            }
+            if (!pending.get()) {
+                throw ExecError("cannot read back a sort run");
+            }
+            // Swapping the vectors swaps their storage, so the block just read becomes buffers[0]
+            swap(buffers[0], buffers[1]);
+            requestBlock();
+        }
+};
+
+// Merges sorted runs on one key column with a tree of losers
+// Every inner node keeps the run that lost the comparison there and tree[0] the overall winner, so
+// replacing the winner takes one comparison per level
+class SortedStream {
+    public:
+        vector<unique_ptr<RunReader>> readers;
+        vector<int> tree;
+        int keyCol = 0;
+
+        void open(const vector<SortRun>& runs, int ncols, int key, size_t blockRecords, ReadAheadThread* io) {
+            keyCol = key;
+            for (unsigned int i = 0; i < runs.size(); i++) {
+                readers.push_back(unique_ptr<RunReader>(new RunReader()));
+                readers.back()->open(runs[i], ncols, blockRecords, io);
+            }
+            int k = readers.size();
+            tree.assign(max(k, 1), -1);
+            for (int i = k - 1; i >= 0; i--) {
+                adjust(i);
+            }
+        }
+        // Returns the smallest remaining record, or NULL once every run is exhausted
+        const int32_t* current() const {
+            return readers.empty() ? NULL : readers[tree[0]]->current();
+        }
+        void advance() {
+            int winner = tree[0];
+            readers[winner]->advance();
+            adjust(winner);
+        }
+
+    private:
+        // Whether run a comes before run b; exhausted runs come last and ties go to the earlier run
+        bool before(int a, int b) const {
+            const int32_t* x = readers[a]->current();
+            const int32_t* y = readers[b]->current();
+            if (x == NULL || y == NULL) {
+                return y == NULL && (x != NULL || a < b);
+            }
+            return (x[keyCol] != y[keyCol]) ? x[keyCol] < y[keyCol] : a < b;
+        }
+        // Plays the run at a leaf up towards the root
+        void adjust(int leaf) {
+            int k = readers.size();
+            int winner = leaf;
+            for (int node = (leaf + k)/2; node > 0; node /= 2) {
+                if (tree[node] == -1) {
+                    tree[node] = winner;
+                    return;
+                }
+                if (before(tree[node], winner)) {
+                    swap(tree[node], winner);
+                }
+            }
+            tree[0] = winner;
+        }
+};
+
+// Sorts the rows one worker feeds to one side of a sort, spilling a sorted run whenever the buffer is full
+class RunBuilder {
+    public:
+        int ncols = 0;
+        int keyCol = 0;
+        size_t maxRecords = 1;
+        vector<int32_t> records;
+        vector<int32_t> sorted;
+        TempFile file;
+        vector<SortRun> runs;
+        bool failed = false;
+
+        void add(const Batch& batch) {
+            int n = batch.size();
+            size_t start = records.size();
+            records.resize(start + (size_t)n*ncols);
+            int32_t* dest = records.data() + start;
+            for (int i = 0; i < n; i++) {
+                uint32_t r = batch.row(i);
+                for (int c = 0; c < ncols; c++) {
+                    dest[(size_t)i*ncols + c] = batch.cols[c][r];
+                }
+            }
+            if (records.size()/ncols >= maxRecords) {
+                spill();
+            }
+        }
+        // Keeps the last rows in memory if nothing had to be spilled
+        void finish() {
+            if (records.empty()) {
+                return;
+            }
+            if (!runs.empty()) {
+                spill();
+                return;
+            }
+            sortRecords();
+            SortRun run;
+            run.memory = sorted.data();
+            run.nrecords = sorted.size()/ncols;
+            runs.push_back(run);
+            records = vector<int32_t>();
+        }
+
+    private:
+        // Sorts (key, position) pairs packed into 64 bits, then moves the records into that order
+        void sortRecords() {
+            size_t n = records.size()/ncols;
+            vector<uint64_t> order(n);
+            for (size_t i = 0; i < n; i++) {
+                uint32_t key = (uint32_t)records[i*ncols + keyCol] ^ 0x80000000u;
+                order[i] = ((uint64_t)key << 32) | i;
+            }
+            sort(order.begin(), order.end());
+            sorted.resize(records.size());
+            for (size_t i = 0; i < n; i++) {
+                memcpy(&(sorted[i*ncols]), &(records[(order[i] & 0xffffffff)*ncols]), ncols*sizeof(int32_t));
+            }
+        }
+        void spill() {
+            sortRecords();
+            SortRun run;
+            run.file = &file;
+            run.offset = file.size;
+            run.nrecords = sorted.size()/ncols;
+            failed = failed || !file.append(sorted.data(), sorted.size()*sizeof(int32_t));
+            runs.push_back(run);
+            records.clear();
+        }
+};
+
+// Merges groups of runs into longer ones until at most fanIn are left
+vector<SortRun> reduceRuns(vector<SortRun> runs, int ncols, int keyCol, int fanIn, size_t blockRecords, TempFile* file) {
+    while ((int)runs.size() > fanIn) {
+        vector<SortRun> merged;
+        vector<int32_t> out;
+        for (unsigned int first = 0; first < runs.size(); first += fanIn) {
+            vector<SortRun> group(runs.begin() + first, runs.begin() + min<size_t>(first + fanIn, runs.size()));
+            SortRun run;
+            run.file = file;
+            run.offset = file->size;
+            {
+                SortedStream stream;
+                ReadAheadThread io;
+                stream.open(group, ncols, keyCol, blockRecords, &io);
+                for (const int32_t* record = stream.current(); record != NULL; stream.advance(), record = stream.current()) {
+                    out.insert(out.end(), record, record + ncols);
+                    run.nrecords++;
+                    if (out.size() >= blockRecords*ncols) {
+                        if (!file->append(out.data(), out.size()*sizeof(int32_t))) {
+                            throw ExecError("cannot write a sort run");
+                        }
+                        out.clear();
+                    }
+                }
+            }
+            if (!out.empty() && !file->append(out.data(), out.size()*sizeof(int32_t))) {
+                throw ExecError("cannot write a sort run");
+            }
+            out.clear();
+            merged.push_back(run);
+        }
+        runs = merged;
+    }
+    return runs;
+}
+
+// Joins its inputs by sorting both on their join column and merging them
+// Every worker sorts the rows it is fed into runs. Once both inputs are complete one worker merges the runs
+// of all workers and pushes the joined rows, in key order, through its copy of the pipeline above
+class MergeJoinOperator : public ExecOperator {
+    public:
+        int probeCol = -1;
+        int buildCol = -1;
+        RunBuilder sides[2];
+        vector<vector<int32_t>> outCols;
+        int nout = 0;
+        Batch out;
+
+        void consume(Batch& batch, int from) {
+            sides[from].add(batch);
+        }
+        // The runs of all the copies are merged by runMergeJoin
+        void finish(int from) {
+            sides[from].finish();
+        }
+        // Joins the sorted inputs, buffering the right rows of one key while the left rows with it go by
+        void merge(SortedStream& left, SortedStream& right) {
+            int nleft = inputs[0]->schema.size();
+            int nright = inputs[1]->schema.size();
+            outCols.assign(schema.size(), vector<int32_t>(BATCH_SIZE));
+            vector<int32_t> group;
+            const int32_t* l = left.current();
+            const int32_t* r = right.current();
+            while (l != NULL && r != NULL) {
+                if (l[probeCol] < r[buildCol]) {
+                    left.advance();
+                    l = left.current();
+                } else if (l[probeCol] > r[buildCol]) {
+                    right.advance();
+                    r = right.current();
+                } else {
+                    int32_t key = r[buildCol];
+                    group.clear();
+                    for (; r != NULL && r[buildCol] == key; right.advance(), r = right.current()) {
+                        group.insert(group.end(), r, r + nright);
+                    }
+                    for (; l != NULL && l[probeCol] == key; left.advance(), l = left.current()) {
+                        for (size_t g = 0; g < group.size(); g += nright) {
+                            addRow(l, nleft, &(group[g]), nright);
+                        }
+                    }
+                }
+            }
+            flush();
+        }
+        void addRow(const int32_t* l, int nleft, const int32_t* r, int nright) {
+            for (int c = 0; c < nleft; c++) {
+                outCols[c][nout] = l[c];
+            }
+            for (int c = 0; c < nright; c++) {
+                outCols[nleft + c][nout] = r[c];
+            }
+            if (++nout == BATCH_SIZE) {
+                flush();
+            }
+        }
+        void flush() {
+            if (nout == 0) {
+                return;
+            }
+            out.count = nout;
+            out.cols.resize(outCols.size());
+            for (unsigned int c = 0; c < outCols.size(); c++) {
+                out.cols[c] = outCols[c].data();
+            }
+            nout = 0;
+            emit(out);
+        }
+};
+
+// Counts the result rows and optionally writes them as CSV
+// The copies of all workers write to the same stream, one batch at a time
+class ResultOperator : public ExecOperator {
+    public:
+        ostream* csv = NULL;
+        mutex* csvLock = NULL;
+
+        void consume(Batch& batch, int from) {
+            rows += batch.size();
+            if (csv == NULL) {
+                return;
+            }
+            string text;
+            for (int i = 0; i < batch.size(); i++) {
+                uint32_t r = batch.row(i);
+                for (unsigned int c = 0; c < batch.cols.size(); c++) {
+                    text += (c > 0) ? "," : "";
+                    text += to_string(batch.cols[c][r]);
+                }
+                text += "\n";
+            }
+            lock_guard<mutex> guard(*csvLock);
+            *csv << text;
+        }
+        void finish(int from) {}
+};
+
+// For holding the operators and open data files of one execution
+// Every worker gets its own copy of the operator tree; the copies share the data files and join tables
+struct ExecPlan {
+    vector<unique_ptr<ExecOperator>> operators;
+    map<string, unique_ptr<ColumnFile>> files;
+    map<Node*, unique_ptr<JoinTable>> joinTables;
+    // Operator of each worker for every plan node, in worker order
+    map<Node*, vector<ExecOperator*>> copies;
+    vector<unique_ptr<BloomFilter>> blooms;
+    vector<ResultOperator> results;
+    uint64_t spilledBytes = 0;
+};
+
+// Catalog version up to which the column files of the base tables have been interned
+long dataColumnsVersion = -1;
+
+// Interns the column names of the data files of the base tables that changed since the last call
+// Batch workers build their operators concurrently, so the names are interned while the catalog is loaded
+// and the operators only look them up
+void internDataColumns() {
+    if (dataDir == "") {
+        return;
+    }
+    for (unsigned int i = 0; i < catalog.tables.size(); i++) {
+        if (catalog.tables[i].isOpTable || catalog.tables[i].version <= dataColumnsVersion) {
+            continue;
+        }
+        ColumnFile file;
+        string error;
+        if (file.open(columnFilePath(dataDir, catalog.tables[i].name), error)) {
+            for (unsigned int j = 0; j < file.names.size(); j++) {
+                internColumn(file.names[j]);
+            }
+        }
+    }
+    dataColumnsVersion = catalogVersion;
+}
+
+// Maps the column file of a base table once per plan
+ColumnFile* openColumnFile(ExecPlan* plan, const string& tableName) {
+    auto found = plan->files.find(tableName);
+    if (found == plan->files.end()) {
+        unique_ptr<ColumnFile> file(new ColumnFile());
+        string error;
+        if (!file->open(columnFilePath(dataDir, tableName), error)) {
+            throw ExecError(error);
+        }
+        found = plan->files.insert({tableName, move(file)}).first;
+    }
+    return found->second.get();
+}
+
+// Creates the operators running the subtree below a plan node
+ExecOperator* buildOperator(Node* node, ExecPlan* plan) {
+    Operation* op = node->op;
+    ExecOperator* exec = NULL;
+    if (op->opType == "") {
+        ScanOperator* scan = new ScanOperator();
+        scan->file = openColumnFile(plan, op->name);
+        for (unsigned int i = 0; i < scan->file->names.size(); i++) {
+            int colId = lookupColumn(scan->file->names[i]);
+            if (colId < 0) {
+                throw ExecError("column " + scan->file->names[i] + " of " + op->name + " was added after the catalog was loaded");
+            }
+            scan->schema.push_back(colId);
+        }
+        exec = scan;
+    } else if (op->opType == "JOIN") {
+        ExecOperator* left = buildOperator(node->left, plan);
+        ExecOperator* right = buildOperator(node->right, plan);
+        // The enumerator may have swapped the inputs, so look the join columns up on both sides
+        int leftCol = left->position(op->join_col1);
+        int rightCol = right->position(op->join_col2);
+        if (leftCol < 0 || rightCol < 0) {
+            leftCol = left->position(op->join_col2);
+            rightCol = right->position(op->join_col1);
+        }
+        if (leftCol < 0 || rightCol < 0) {
+            throw ExecError("join columns " + op->join_col1 + " and " + op->join_col2 + " are not available at " + op->name);
+        }
+        if (op->joinMethod == JOIN_SORT_MERGE) {
+            MergeJoinOperator* join = new MergeJoinOperator();
+            join->probeCol = leftCol;
+            join->buildCol = rightCol;
+            // Each worker gets an equal share of the buffer pages for the records it buffers and their sorted copy
+            size_t budget = max<size_t>((size_t)bufferPages*EXEC_PAGE_BYTES/execThreads, EXEC_PAGE_BYTES);
+            ExecOperator* sideInputs[2] = {left, right};
+            for (int i = 0; i < 2; i++) {
+                join->sides[i].ncols = sideInputs[i]->schema.size();
+                join->sides[i].keyCol = (i == 0) ? leftCol : rightCol;
+                join->sides[i].maxRecords = max<size_t>(budget/(2*join->sides[i].ncols*sizeof(int32_t)), 1);
+            }
+            exec = join;
+        } else {
+            HashJoinOperator* join = new HashJoinOperator();
+            unique_ptr<JoinTable>& shared = plan->joinTables[node];
+            if (!shared) {
+                shared.reset(new JoinTable());
+            }
+            join->shared = shared.get();
+            join->probeCol = leftCol;
+            join->buildCol = rightCol;
+            exec = join;
+        }
+        exec->inputs = {left, right};
+        exec->schema = left->schema;
+        exec->schema.insert(exec->schema.end(), right->schema.begin(), right->schema.end());
+    } else {
+        ExecOperator* input = buildOperator(node->left, plan);
+        if (op->opType == "SELECTION") {
+            SelectOperator* select = new SelectOperator();
+            select->col = input->position(op->sel_col);
+            if (select->col < 0) {
+                throw ExecError("column " + op->sel_col + " is not available at " + op->name);
+            }
+            select->filter = planFilter(op);
+            select->schema = input->schema;
+            exec = select;
+        } else {
+            ProjectOperator* project = new ProjectOperator();
+            vector<string> cols = splitColumns(op->proj_cols);
+            for (unsigned int i = 0; i < cols.size(); i++) {
+                int pos = input->position(cols[i]);
+                if (pos < 0) {
+                    throw ExecError("column " + cols[i] + " is not available at " + op->name);
+                }
+                project->positions.push_back(pos);
+                project->schema.push_back(input->schema[pos]);
+            }
+            exec = project;
+        }
+        exec->inputs = {input};
+    }
+    exec->node = node;
+    for (unsigned int i = 0; i < exec->inputs.size(); i++) {
+        exec->inputs[i]->consumer = exec;
+        exec->inputs[i]->side = i;
+    }
+    plan->operators.push_back(unique_ptr<ExecOperator>(exec));
+    plan->copies[node].push_back(exec);
+    return exec;
+}
+
+// Merges the build rows every worker collected for a join and builds its hash table
+void buildJoinTable(ExecPlan* plan, Node* node) {
+    vector<ExecOperator*>& joins = plan->copies[node];
+    HashJoinOperator* first = (HashJoinOperator*)joins[0];
+    JoinTable* shared = first->shared;
+    int ncols = first->inputs[1]->schema.size();
+    shared->build.assign(ncols, vector<int32_t>());
+    WorkStealingPool pool(min(execThreads, max(ncols, 1)));
+    pool.start(ncols, [&](int c) {
+        size_t total = 0;
+        for (unsigned int w = 0; w < joins.size(); w++) {
+            HashJoinOperator* join = (HashJoinOperator*)joins[w];
+            total += (c < (int)join->local.size()) ? join->local[c].size() : 0;
+        }
+        shared->build[c].reserve(total);
+        for (unsigned int w = 0; w < joins.size(); w++) {
+            HashJoinOperator* join = (HashJoinOperator*)joins[w];
+            if (c < (int)join->local.size()) {
+                shared->build[c].insert(shared->build[c].end(), join->local[c].begin(), join->local[c].end());
+                vector<int32_t>().swap(join->local[c]);
+            }
+        }
+    });
+    pool.wait();
+    if (first->buildCol < 0) {
+        return;
+    }
+    // Keep the build values of a partition together so matches are gathered from cache too
+    vector<uint32_t> order = shared->table.build(shared->build[first->buildCol], execThreads);
+    pool.start(ncols, [&](int c) {
+        vector<int32_t> permuted(order.size());
+        gatherValues(shared->build[c].data(), order.data(), order.size(), permuted.data());
+        shared->build[c].swap(permuted);
+    });
+    pool.wait();
+}
+
+// Lets every copy of an operator tell its consumer that it has delivered all its rows
+void finishCopies(ExecPlan* plan, Node* node) {
+    vector<ExecOperator*>& copies = plan->copies[node];
+    WorkStealingPool pool(execThreads);
+    pool.start(copies.size(), [&](int w) {
+        copies[w]->consumer->finish(copies[w]->side);
+    });
+    pool.wait();
+}
+
+// Runs the pipeline starting at a base table scan
+// The table is cut into morsels that the workers take from a work-stealing queue and push through their copy
+// of the pipeline. Once all morsels are done every copy flushes the rows it still buffers
+void runScan(ExecPlan* plan, Node* node) {
+    vector<ExecOperator*>& scans = plan->copies[node];
+    uint64_t nrows = ((ScanOperator*)scans[0])->file->nrows;
+    int nmorsels = (nrows + MORSEL_ROWS - 1)/MORSEL_ROWS;
+    WorkStealingPool pool(execThreads);
+    pool.startWorkers(nmorsels, [&](int m, int w) {
+        ((ScanOperator*)scans[w])->scan((uint64_t)m*MORSEL_ROWS, min(nrows, (uint64_t)(m + 1)*MORSEL_ROWS));
+    });
+    pool.wait();
+    finishCopies(plan, node);
+}
+
+// Merges the sorted runs both inputs of a sort-merge join left behind and joins them on the first worker
+// Each side gets half of the buffer pages, and every run being merged holds two pages: the block being read
+// and the one read ahead. Longer run lists are first merged down to that fan-in through a temp file
+void runMergeJoin(ExecPlan* plan, Node* node) {
+    vector<ExecOperator*>& joins = plan->copies[node];
+    MergeJoinOperator* first = (MergeJoinOperator*)joins[0];
+    int fanIn = max(2, (bufferPages/2 - 1)/2);
+    TempFile mergeFiles[2];
+    vector<SortRun> runs[2];
+    size_t blockRecords[2];
+    for (int i = 0; i < 2; i++) {
+        int ncols = first->sides[i].ncols;
+        blockRecords[i] = max<size_t>(EXEC_PAGE_BYTES/(ncols*sizeof(int32_t)), 1);
+        for (unsigned int w = 0; w < joins.size(); w++) {
+            RunBuilder* side = &(((MergeJoinOperator*)joins[w])->sides[i]);
+            if (side->failed) {
+                throw ExecError("cannot write a sort run");
+            }
+            runs[i].insert(runs[i].end(), side->runs.begin(), side->runs.end());
+            plan->spilledBytes += side->file.size;
+        }
+        runs[i] = reduceRuns(runs[i], ncols, first->sides[i].keyCol, fanIn, blockRecords[i], &(mergeFiles[i]));
+        plan->spilledBytes += mergeFiles[i].size;
+    }
+    // The read-ahead thread is declared last so it is stopped before the buffers it reads into go away
+    SortedStream left;
+    SortedStream right;
+    ReadAheadThread io;
+    left.open(runs[0], first->sides[0].ncols, first->sides[0].keyCol, blockRecords[0], &io);
+    right.open(runs[1], first->sides[1].ncols, first->sides[1].keyCol, blockRecords[1], &io);
+    first->merge(left, right);
+    finishCopies(plan, node);
+}
+
+// Runs every pipeline below a plan node, completing the build side of each join before its probe side
+void runPipelines(ExecPlan* plan, Node* node) {
+    if (node->op->opType == "JOIN" && node->op->joinMethod == JOIN_SORT_MERGE) {
+        runPipelines(plan, node->right);
+        runPipelines(plan, node->left);
+        runMergeJoin(plan, node);
+    } else if (node->op->opType == "JOIN") {
+        runPipelines(plan, node->right);
+        buildJoinTable(plan, node);
+        runPipelines(plan, node->left);
+    } else if (node->op->opType != "") {
+        runPipelines(plan, node->left);
+    } else {
+        runScan(plan, node);
+    }
+}
+
+// Prints the estimated and actual rows of every operator, parents before children
+void printRowCounts(ExecPlan* plan, ExecOperator* exec, ostream& out) {
+    long rows = 0;
+    vector<ExecOperator*>& copies = plan->copies[exec->node];
+    for (unsigned int w = 0; w < copies.size(); w++) {
+        rows += copies[w]->rows;
+    }
+    out << left << setw(40) << nodeLabel(exec->node) << right << setw(16) << llround(exec->node->op->ntuples)
+        << setw(16) << rows << endl;
+    for (unsigned int i = 0; i < exec->inputs.size(); i++) {
+        printRowCounts(plan, exec->inputs[i], out);
+    }
+}
+
+// Returns the position of a column in a column file, throwing if it is not there
+int columnPosition(ColumnFile* file, const string& tableName, const string& colName) {
+    for (unsigned int i = 0; i < file->names.size(); i++) {
+        if (file->names[i] == colName) {
+            return i;
+        }
+    }
+    throw ExecError("column " + colName + " is not in " + tableName);
+}
+
+// Builds the bloom filter of a semi-join reduction from the keys of the filtered table that pass its selections
+// and hands it to every copy of the scan it reduces
+void attachSemiJoin(ExecPlan* plan, const SemiJoin& sj) {
+    ColumnFile* keys = openColumnFile(plan, sj.keyTable);
+    int keyCol = columnPosition(keys, sj.keyTable, sj.keyCol);
+    vector<int> filterCols;
+    vector<FilterPlan> filters;
+    for (unsigned int i = 0; i < sj.filters.size(); i++) {
+        filterCols.push_back(columnPosition(keys, sj.keyTable, sj.filters[i]->sel_col));
+        filters.push_back(planFilter(sj.filters[i]));
+    }
+    BloomFilter* bloom = new BloomFilter();
+    plan->blooms.push_back(unique_ptr<BloomFilter>(bloom));
+    bloom->init(keys->nrows);
+    // Selections narrow the candidate rows in turn, swapping between two selection vectors with a third as scratch
+    vector<uint32_t> sel[3] = {vector<uint32_t>(BATCH_SIZE), vector<uint32_t>(BATCH_SIZE), vector<uint32_t>(BATCH_SIZE)};
+    for (uint64_t start = 0; start < keys->nrows; start += BATCH_SIZE) {
+        int count = min<uint64_t>(BATCH_SIZE, keys->nrows - start);
+        const uint32_t* rows = NULL;
+        for (unsigned int i = 0; i < filters.size() && count > 0; i++) {
+            uint32_t* out = sel[i % 2].data();
+            count = runFilter(filters[i], keys->columns[filterCols[i]] + start, rows, count, out, sel[2].data());
+            rows = out;
+        }
+        const int32_t* values = keys->columns[keyCol] + start;
+        for (int i = 0; i < count; i++) {
+            bloom->add(values[(rows != NULL) ? rows[i] : i]);
+        }
+    }
+    vector<ExecOperator*>& scans = plan->copies[findNode(sj.table)];
+    for (unsigned int w = 0; w < scans.size(); w++) {
+        int col = scans[w]->position(sj.col);
+        if (col < 0) {
+            throw ExecError("column " + sj.col + " is not in " + sj.table);
+        }
+        ((ScanOperator*)scans[w])->blooms.push_back(make_pair(col, bloom));
+    }
+}
+
+// Runs an optimized plan over the column files in dataDir and compares its row counts with the estimates
+void executeQuery(Node* root, ostream& out) {
+    auto start = chrono::steady_clock::now();
+    ExecPlan plan;
+    ofstream csv;
+    mutex csvLock;
+    try {
+        plan.results.resize(execThreads);
+        ExecOperator* top = NULL;
+        for (int w = 0; w < execThreads; w++) {
+            top = buildOperator(root, &plan);
+            top->consumer = &(plan.results[w]);
+        }
+        if (resultFile != "") {
+            csv.open(resultFile, ios::trunc);
+            for (unsigned int i = 0; i < top->schema.size(); i++) {
+                csv << (i > 0 ? "," : "") << columnNames[top->schema[i]];
+            }
+            csv << "\n";
+            for (int w = 0; w < execThreads; w++) {
+                plan.results[w].csv = &csv;
+                plan.results[w].csvLock = &csvLock;
+            }
+        }
+        for (unsigned int i = 0; i < query.semiJoins.size(); i++) {
+            if (query.semiJoins[i].active) {
+                attachSemiJoin(&plan, query.semiJoins[i]);
+            }
+        }
+        runPipelines(&plan, root);
+
+        long rows = 0;
+        for (int w = 0; w < execThreads; w++) {
+            rows += plan.results[w].rows;
+        }
+        double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        out << left << setw(40) << "Operator" << right << setw(16) << "Estimated rows" << setw(16) << "Actual rows" << endl;
+        printRowCounts(&plan, top, out);
+        out << "Rows: " << rows << endl;
+        if (plan.spilledBytes > 0) {
+            out << "Sort spills: " << (plan.spilledBytes + 1023)/1024 << " KB" << endl;
+        }
+        out << "Execution time: " << elapsed << " ms" << endl;
+        out << endl;
+    } catch (const ExecError& e) {
+        out << "Execution failed: " << e.what() << endl << endl;
+    }
+}
+
+// Coefficients a cost profile can set, in the order of the calibration features
+const int NUM_COST_TERMS = 7;
+const char* costTermNames[NUM_COST_TERMS] = {"seq_page", "random_page", "write_page", "index_probe", "cpu_tuple", "hash_tuple", "sort_tuple"};
+
+// Returns the coefficient of the cost profile stored under a cost term
+double* costTerm(CostProfile* profile, int term) {
+    double* terms[NUM_COST_TERMS] = {&(profile->seqPage), &(profile->randomPage), &(profile->writePage), &(profile->indexProbe),
+                                     &(profile->cpuTuple), &(profile->hashTuple), &(profile->sortTuple)};
+    return terms[term];
+}
+
+// Loads the coefficients of the cost model from a profile written by --calibrate
+// Each line holds "name = value", blank lines and lines starting with # are skipped
+bool loadCostProfile(const string& fileName) {
+    ifstream in(fileName);
+    if (!in) {
+        cerr << "Could not open cost profile " << fileName << endl;
+        return false;
+    }
+    CostProfile profile;
+    string line;
+    for (int lineNo = 1; getline(in, line); lineNo++) {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == string::npos || line[start] == '#') {
+            continue;
+        }
+        size_t eq = line.find('=');
+        if (eq == string::npos) {
+            cerr << fileName << ":" << lineNo << ": error: expected name = value" << endl;
+            return false;
+        }
+        string name = line.substr(start, eq - start);
+        name.erase(name.find_last_not_of(" \t") + 1);
+        int term = find(costTermNames, costTermNames + NUM_COST_TERMS, name) - costTermNames;
+        if (term == NUM_COST_TERMS) {
+            cerr << fileName << ":" << lineNo << ": error: unknown cost term '" << name << "'" << endl;
+            return false;
+        }
+        istringstream value(line.substr(eq + 1));
+        double coefficient;
+        string rest;
+        if (!(value >> coefficient) || (value >> rest) || coefficient < 0) {
+            cerr << fileName << ":" << lineNo << ": error: invalid value for " << name << endl;
+            return false;
+        }
+        *costTerm(&profile, term) = coefficient;
+    }
+    costProfile = profile;
+    return true;
+}
+
+// Writes the coefficients of a cost profile in the format read by loadCostProfile
+bool writeCostProfile(const string& fileName, CostProfile profile) {
+    ofstream out(fileName, ios::trunc);
+    out << "# Cost profile written by --calibrate" << endl;
+    out << "# Coefficients are relative to reading one page sequentially" << endl;
+    out << setprecision(6);
+    for (int t = 0; t < NUM_COST_TERMS; t++) {
+        out << costTermNames[t] << " = " << *costTerm(&profile, t) << endl;
+    }
+    out.close();
+    if (!out) {
+        cerr << "Could not write cost profile " << fileName << endl;
+        return false;
+    }
+    return true;
+}
+
+// One timed run of a calibration micro-plan: how often it exercised each cost term, and how long it took
+struct CostSample {
+    double counts[NUM_COST_TERMS] = {0};
+    double ms = 0;
+};
+
+// Returns the milliseconds fn takes to run
+template <typename F>
+double timeMs(F fn) {
+    auto start = chrono::steady_clock::now();
+    fn();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// Reads one page of a file at a page number
+void readPage(int fd, long page, char* buffer) {
+    if (pread(fd, buffer, EXEC_PAGE_BYTES, (off_t)page*EXEC_PAGE_BYTES) != EXEC_PAGE_BYTES) {
+        throw ExecError("cannot read the calibration file");
+    }
+}
+
+// Drops the pages of a file from the OS cache, so that the next reads go to the device
+void dropCache(int fd) {
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+// Times the page I/O micro-plans against a scratch file of filePages pages
+void samplePageIo(int fd, long filePages, vector<CostSample>* samples) {
+    vector<char> page(EXEC_PAGE_BYTES, 'q');
+    mt19937 rng(42);
+    uniform_int_distribution<long> anyPage(0, filePages - 1);
+    for (long n = filePages/4; n <= filePages; n *= 2) {
+        CostSample writes;
+        writes.counts[2] = n;
+        writes.ms = timeMs([&]() {
+            for (long p = 0; p < n; p++) {
+                if (pwrite(fd, &(page[0]), EXEC_PAGE_BYTES, (off_t)p*EXEC_PAGE_BYTES) != EXEC_PAGE_BYTES) {
+                    throw ExecError("cannot write the calibration file");
+                }
+            }
+            fdatasync(fd);
+        });
+        samples->push_back(writes);
+
+        CostSample scan;
+        scan.counts[0] = n;
+        dropCache(fd);
+        scan.ms = timeMs([&]() {
+            for (long p = 0; p < n; p++) {
+                readPage(fd, p, &(page[0]));
+            }
+        });
+        samples->push_back(scan);
+    }
+    for (long n = filePages/16; n <= filePages/4; n *= 2) {
+        CostSample random;
+        random.counts[1] = n;
+        dropCache(fd);
+        random.ms = timeMs([&]() {
+            for (long p = 0; p < n; p++) {
+                readPage(fd, anyPage(rng), &(page[0]));
+            }
+        });
+        samples->push_back(random);
+
+        // An index probe descends to a leaf, whose upper levels stay cached, and fetches one heap page
+        // The engine has no index structures, so the probe is emulated with the page reads it would do
+        CostSample probes;
+        probes.counts[3] = n;
+        uniform_int_distribution<long> leafPage(0, min(filePages, 64L) - 1);
+        dropCache(fd);
+        probes.ms = timeMs([&]() {
+            for (long p = 0; p < n; p++) {
+                readPage(fd, leafPage(rng), &(page[0]));
+                readPage(fd, anyPage(rng), &(page[0]));
+            }
+        });
+        samples->push_back(probes);
+    }
+}
+
+// Times the in-memory micro-plans: filtering, hashing and sorting tuples
+void sampleCpu(vector<CostSample>* samples) {
+    mt19937 rng(42);
+    for (int n = 1 << 20; n <= 1 << 22; n *= 2) {
+        vector<int32_t> values(n);
+        for (int i = 0; i < n; i++) {
+            values[i] = rng() % n;
+        }
+
+        CostSample filter;
+        filter.counts[4] = n;
+        vector<uint32_t> sel(BATCH_SIZE);
+        long kept = 0;
+        filter.ms = timeMs([&]() {
+            for (int i = 0; i < n; i += BATCH_SIZE) {
+                kept += filterValues(&(values[i]), NULL, min(BATCH_SIZE, n - i), '>', n/2, &(sel[0]));
+            }
+        });
+        samples->push_back(filter);
+
+        // A hash join touches every tuple of both inputs once, here both inputs are the same column
+        CostSample hash;
+        hash.counts[5] = 2.0*n;
+        long matches = 0;
+        hash.ms = timeMs([&]() {
+            RadixHashTable table;
+            table.build(values, 1);
+            for (int i = 0; i < n; i++) {
+                table.probe(values[i], RadixHashTable::hashKey(values[i]), [&](uint32_t) { matches++; });
+            }
+        });
+        samples->push_back(hash);
+
+        CostSample sorted;
+        sorted.counts[6] = n*log2(n);
+        sorted.ms = timeMs([&]() {
+            sort(values.begin(), values.end());
+        });
+        samples->push_back(sorted);
+
+        // Keeps the results alive so the loops are not optimized away
+        if (kept < 0 || matches < 0) {
+            throw ExecError("calibration overflow");
+        }
+    }
+}
+
+// Builds the query of one statement against the loaded catalog and returns the root of its tree
+Node* calibrationQuery(const string& statement) {
+    query.clear();
+    processStatement(parseStatement(statement, 1));
+    updateOpTbls();
+    startReuse(CachedPlan());
+    calcOpCosts();
+    return createQueryTree()->root;
+}
+
+// Counts how often a plan exercises each cost term by costing it with that coefficient set to 1 and the
+// others to 0. Every cost formula is linear in the coefficients, so the counts add up to the plan's cost
+void planCounts(Node* root, JoinMethod method, CostSample* sample) {
+    CostProfile saved = costProfile;
+    for (int t = 0; t < NUM_COST_TERMS; t++) {
+        for (int u = 0; u < NUM_COST_TERMS; u++) {
+            *costTerm(&costProfile, u) = (u == t) ? 1 : 0;
+        }
+        calcOpCosts();
+        if (method != JOIN_NONE) {
+            root->op->joinMethod = method;
+        }
+        sample->counts[t] = subtreePlan(root).cost;
+    }
+    costProfile = saved;
+}
+
+// Times scans and joins of the tables in the data directory, with the term counts the cost model gives them
+// Every table with a data file is scanned, and every foreign key between two of them is joined with each
+// algorithm the engine runs, so a sample mixes page, tuple and hash or sort terms
+void samplePlans(vector<CostSample>* samples) {
+    vector<string> statements;
+    vector<JoinMethod> methods;
+    vector<vector<string>> tables;
+    for (unsigned int i = 0; i < catalog.tables.size(); i++) {
+        Table* tbl = &(catalog.tables[i]);
+        if (tbl->isOpTable || tbl->columns.empty() || tbl->npages <= 0 || access(columnFilePath(dataDir, tbl->name).c_str(), R_OK) != 0) {
+            continue;
+        }
+        statements.push_back("RESULT = " + tbl->name + " PROJECTION " + tbl->columns[0]);
+        methods.push_back(JOIN_NONE);
+        tables.push_back({tbl->name});
+        for (unsigned int j = 0; j < tbl->fks.size(); j++) {
+            Table* ref = catalog.findTable(tbl->fks[j].ref_table);
+            if (ref == nullptr || ref->npages <= 0 || access(columnFilePath(dataDir, ref->name).c_str(), R_OK) != 0) {
+                continue;
+            }
+            JoinMethod algorithms[2] = {JOIN_HASH, JOIN_SORT_MERGE};
+            for (int a = 0; a < 2; a++) {
+                statements.push_back("RESULT = " + tbl->name + " JOIN " + ref->name + " ON " + tbl->fks[j].col + "=" + tbl->fks[j].ref_col);
+                methods.push_back(algorithms[a]);
+                tables.push_back({tbl->name, ref->name});
+            }
+        }
+    }
+    for (unsigned int i = 0; i < statements.size(); i++) {
+        Node* root = calibrationQuery(statements[i]);
+        CostSample plan;
+        planCounts(root, methods[i], &plan);
+        for (int run = 0; run < 3; run++) {
+            for (unsigned int t = 0; t < tables[i].size(); t++) {
+                int fd = open(columnFilePath(dataDir, tables[i][t]).c_str(), O_RDONLY);
+                if (fd >= 0) {
+                    dropCache(fd);
+                    close(fd);
+                }
+            }
+            ostringstream out;
+            plan.ms = timeMs([&]() { executeQuery(root, out); });
+            if (out.str().find("Execution failed") != string::npos) {
+                throw ExecError(statements[i] + ": " + out.str());
+            }
+            samples->push_back(plan);
+        }
+    }
+    query.clear();
+}
+
+// Fits the coefficients to the samples by least squares, solving the normal equations by Gaussian elimination
+// Coefficients are returned in milliseconds per unit, a term no sample exercised gets 0
+vector<double> fitCostTerms(const vector<CostSample>& samples) {
+    const int n = NUM_COST_TERMS;
+    vector<vector<double>> a(n, vector<double>(n + 1, 0));
+    for (const CostSample& s : samples) {
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                a[i][j] += s.counts[i]*s.counts[j];
+            }
+            a[i][n] += s.counts[i]*s.ms;
+        }
+    }
+    for (int c = 0; c < n; c++) {
+        int pivot = c;
+        for (int r = c + 1; r < n; r++) {
+            if (fabs(a[r][c]) > fabs(a[pivot][c])) {
+                pivot = r;
+            }
+        }
+        swap(a[c], a[pivot]);
+        if (a[c][c] == 0) {
+            continue;
+        }
+        for (int r = 0; r < n; r++) {
+            if (r != c && a[r][c] != 0) {
+                double factor = a[r][c]/a[c][c];
+                for (int k = c; k <= n; k++) {
+                    a[r][k] -= factor*a[c][k];
+                }
+            }
+        }
+    }
+    vector<double> x(n, 0);
+    for (int i = 0; i < n; i++) {
+        // Timing noise can push a negligible term below zero, which the cost model cannot use
+        x[i] = (a[i][i] != 0) ? max(a[i][n]/a[i][i], 0.0) : 0;
+    }
+    return x;
+}
+
+// Measures the cost terms on this machine and writes them as a cost profile
+// Page I/O goes to a scratch file in dir. With --execute, plans over the data files are timed too and all
+// the terms are fitted together. Coefficients are scaled so that a sequential page read costs 1
+bool calibrate(const string& dir, const string& profileName) {
+    const long filePages = 8192;
+    vector<CostSample> samples;
+    string path = dir + "/qo-calibrate-XXXXXX";
+    int fd = mkstemp(&(path[0]));
+    if (fd < 0) {
+        cerr << "Could not create calibration file in " << dir << endl;
+        return false;
+    }
+    unlink(path.c_str());
+    try {
+        samplePageIo(fd, filePages, &samples);
+        sampleCpu(&samples);
+        if (dataDir != "") {
+            samplePlans(&samples);
+        }
+    } catch (const ExecError& e) {
+        close(fd);
+        cerr << "Calibration failed: " << e.what() << endl;
+        return false;
+    }
+    close(fd);
+
+    vector<double> ms = fitCostTerms(samples);
+    if (ms[0] <= 0) {
+        cerr << "Calibration failed: sequential reads took no measurable time" << endl;
+        return false;
+    }
+    CostProfile profile;
+    for (int t = 0; t < NUM_COST_TERMS; t++) {
+        *costTerm(&profile, t) = ms[t]/ms[0];
+    }
+    cout << left << setw(14) << "Cost term" << right << setw(14) << "ms per unit" << setw(14) << "Coefficient" << endl;
+    for (int t = 0; t < NUM_COST_TERMS; t++) {
+        cout << left << setw(14) << costTermNames[t] << right << setw(14) << ms[t] << setw(14) << *costTerm(&profile, t) << endl;
+    }
+    return writeCostProfile(profileName, profile);
+}
+
+// Rounds a cost down to whole I/Os for printing, saturating costs too large to fit in a long
+long printedCost(double cost) {
+    return (cost < 9e18) ? (long)cost : LONG_MAX;
+}
+
+// Optimizes the query held in the query context and prints both trees
+void optimizeQuery(ostream& out) {
+    updateOpTbls();
+    // Queries with the same shape reuse the cached join order and are only re-costed
+    // If a table changed since, only the operations and join subsets it feeds into are costed again
+    string key = queryFingerprint();
+    CachedPlan cached;
+    bool current = planCache.get(key, &cached);
+    startReuse(cached);
+    calcOpCosts();
+    QueryTree* qt = createQueryTree();
+    if (qt->root == NULL) {
+        out << "Query has no RESULT operation" << endl;
+        out << endl;
+        flushStats();
+        return;
+    }
+    // Before changes
+    out << "--------------" << endl;
+    out << "| Query Tree |" << endl;
+    out << "--------------" << endl;
+    out << endl;
+    printTree(qt->root, out);
+    out << "Cost: " << printedCost(regularCost()) << " I/Os" << endl;
+    out << endl;
+    out << "------------------------" << endl;
+    out << "| Optimized Query Tree |" << endl;
+    out << "------------------------" << endl;
+    out << endl;
+    // Join algorithms are picked again for the optimized tree
+    for (unsigned int i = 0; i < query.operations.size(); i++) {
+        query.operations[i].joinMethod = JOIN_NONE;
+    }
+    {
+        PhaseTimer timer(PHASE_REWRITE);
+        pushDownSelections(qt->root);
+        reduceJoins(qt->root);
+        pushDownProjections(qt->root);
+        if (current && !applyPlan(&cached)) {
+            planCache.reject();
+            current = false;
+        }
+        if (!current) {
+            recurseTree(qt->root);
+            planCache.put(key, capturePlan(qt->root));
+        }
+    }
+    // Costing settles the algorithm of every join, so it has to run before printing
+    long cost = printedCost(chooseSemiJoins());
+    printTree(qt->root, out);
+    out << "Cost: " << cost << " I/Os" << endl;
+    out << endl;
+    if (dataDir != "") {
+        executeQuery(qt->root, out);
+    }
+    localStats.counters[COUNT_QUERIES]++;
+    flushStats();
+}
+
+// Reads a complete line from a file descriptor, returning false at end of input
+bool readLine(int fd, string* buffer, string* line) {
+    while (true) {
+        size_t newline = buffer->find('\n');
+        if (newline != string::npos) {
+            *line = buffer->substr(0, newline);
+            buffer->erase(0, newline + 1);
+            return true;
+        }
+        char chunk[4096];
+        ssize_t got = read(fd, chunk, sizeof(chunk));
+        if (got <= 0) {
+            // Hand back a final line that has no newline
+            if (buffer->empty()) {
+                return false;
+            }
+            *line = *buffer;
+            buffer->clear();
+            return true;
+        }
+        buffer->append(chunk, got);
+    }
+}
+
+// Writes all of a string to a file descriptor
+void writeAll(int fd, string data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t put = write(fd, data.data() + written, data.size() - written);
+        if (put <= 0) {
+            return;
+        }
+        written += put;
+    }
+}
+
+// Optimizes the query block collected so far and sends back its plan
+void flushQuery(int outFd) {
+    if (query.operations.empty()) {
+        return;
+    }
+    ostringstream out;
+    optimizeQuery(out);
+    writeAll(outFd, out.str());
+    query.clear();
+}
+
+// Serves a stream of query blocks against the resident catalog
+// A block is a run of OP/RESULT statements ended by a blank line or the end of input,
+// while catalog statements in the stream update the resident statistics
+void serveStream(int inFd, int outFd) {
+    string buffer;
+    string line;
+    int lineNo = 0;
+    bool catalogChanged = false;
+    while (readLine(inFd, &buffer, &line)) {
+        ostringstream err;
+        StatementKind kind = processLine(line, ++lineNo, "input", err, false);
+        writeAll(outFd, err.str());
+        if (kind == STMT_NONE && err.str() == "") {
+            flushQuery(outFd);
+        } else if (kind == STMT_OP) {
+            if (catalogChanged) {
+                updateRegTbls();
+                internDataColumns();
+                catalogChanged = false;
+            }
+        } else if (kind != STMT_NONE) {
+            catalogChanged = true;
+        }
+    }
+    if (catalogChanged) {
+        updateRegTbls();
+        internDataColumns();
+    }
+    flushQuery(outFd);
+}
+
+// Accepts connections on a Unix socket and serves each one in turn
+int serveSocket(string path) {
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        cerr << "Could not create socket" << endl;
+        return 1;
+    }
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        cerr << "Socket path is too long: " << path << endl;
+        return 1;
+    }
+    path.copy(addr.sun_path, path.size());
+    unlink(path.c_str());
+    if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd, 16) < 0) {
+        cerr << "Could not listen on socket " << path << endl;
+        return 1;
+    }
+    while (true) {
+        int connFd = accept(listenFd, NULL, NULL);
+        if (connFd < 0) {
+            continue;
+        }
+        serveStream(connFd, connFd);
+        query.clear();
+        close(connFd);
+    }
+    return 0;
+}
+
+// Output formats requested with --stats and --stats-json
+bool statsTable = false;
+bool statsJson = false;
+
+// Prints the per-phase timings and counters gathered so far to stderr
+void printStats() {
+    flushStats();
+    lock_guard<mutex> guard(statsLock);
+    if (statsTable) {
+        ios oldState(nullptr);
+        oldState.copyfmt(cerr);
+        cerr << fixed << setprecision(3);
+        cerr << left << setw(18) << "Phase" << right << setw(10) << "Calls" << setw(14) << "Total ms" << setw(14) << "Avg us" << endl;
+        for (int i = 0; i < NUM_PHASES; i++) {
+            double totalMs = totalStats.phaseNanos[i] / 1e6;
+            double avgUs = (totalStats.phaseCalls[i] > 0) ? totalStats.phaseNanos[i] / 1e3 / totalStats.phaseCalls[i] : 0;
+            cerr << left << setw(18) << phaseNames[i] << right << setw(10) << totalStats.phaseCalls[i]
+                 << setw(14) << totalMs << setw(14) << avgUs << endl;
+        }
+        cerr << endl;
+        cerr << left << setw(18) << "Counter" << right << setw(10) << "Value" << endl;
+        for (int i = 0; i < NUM_COUNTERS; i++) {
+            cerr << left << setw(18) << counterNames[i] << right << setw(10) << totalStats.counters[i] << endl;
+        }
+        cerr.copyfmt(oldState);
+    }
+    if (statsJson) {
+        ostringstream json;
+        json << fixed << setprecision(6) << "{\"phases\": {";
+        for (int i = 0; i < NUM_PHASES; i++) {
+            json << (i > 0 ? ", " : "") << "\"" << phaseNames[i] << "\": {\"calls\": " << totalStats.phaseCalls[i]
+                 << ", \"total_ms\": " << totalStats.phaseNanos[i] / 1e6 << "}";
+        }
+        json << "}, \"counters\": {";
+        for (int i = 0; i < NUM_COUNTERS; i++) {
+            json << (i > 0 ? ", " : "") << "\"" << counterNames[i] << "\": " << totalStats.counters[i];
+        }
+        json << "}, \"plan_cache\": {\"hits\": " << planCache.hits << ", \"misses\": " << planCache.misses << "}}";
+        cerr << json.str() << endl;
+    }
+}
+
+// Reports how well the plan cache did
+void printCacheStats() {
+    cerr << "Plan cache: " << planCache.hits << " hits, " << planCache.misses << " misses" << endl;
+}
+
+// Optimizes one query file in the calling thread's query context
+string optimizeQueryFile(string fileName) {
+    ostringstream out;
+    out << "Query file: " << fileName << endl;
+    out << endl;
+    ifstream inputFile(fileName);
+    if (!inputFile) {
+        out << "Could not open query file " << fileName << endl;
+        out << endl;
+        return out.str();
+    }
+    string line;
+    int lineNo = 0;
+    while (getline(inputFile, line)) {
+        // The catalog is shared between workers, so only query statements are applied
+        PhaseTimer timer(PHASE_PARSE);
+        try {
+            Statement stmt = parseStatement(line, ++lineNo);
+            if (stmt.kind == STMT_OP) {
+                processStatement(stmt);
+            }
+        } catch (const ParseError& e) {
+            out << fileName << ":" << e.line << ":" << e.col << ": error: " << e.what() << endl;
+        }
+    }
+    optimizeQuery(out);
+    query.clear();
+    return out.str();
+}
+
+// Lists the query files of a batch, either the files in a directory or the lines of a manifest
+vector<string> listQueryFiles(string path) {
+    vector<string> files;
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+        DIR* dir = opendir(path.c_str());
+        if (dir != NULL) {
+            struct dirent* entry;
+            while ((entry = readdir(dir)) != NULL) {
+                string filePath = path + "/" + entry->d_name;
+                struct stat fileInfo;
+                if (stat(filePath.c_str(), &fileInfo) == 0 && S_ISREG(fileInfo.st_mode)) {
+                    files.push_back(filePath);
+                }
+            }
+            closedir(dir);
+        }
+        // Sorting keeps the output order independent of the directory order
+        sort(files.begin(), files.end());
+    } else {
+        ifstream manifest(path);
+        string line;
+        while (getline(manifest, line)) {
+            size_t starting = line.find_first_not_of(" \t\r");
+            if (starting != string::npos) {
+                size_t ending = line.find_last_not_of(" \t\r");
+                files.push_back(line.substr(starting, ending - starting + 1));
+            }
+        }
+    }
+    return files;
+}
+
+// Optimizes a batch of query files in parallel, printing the plans in input order
+int runBatch(string path, int nthreads) {
+    vector<string> files = listQueryFiles(path);
+    vector<string> results(files.size());
+    vector<bool> finished(files.size(), false);
+    mutex resultLock;
+    condition_variable resultReady;
+
+    WorkStealingPool pool(nthreads);
+    pool.start(files.size(), [&](int t) {
+        string result = optimizeQueryFile(files[t]);
+        lock_guard<mutex> guard(resultLock);
+        results[t] = result;
+        finished[t] = true;
+        resultReady.notify_one();
+    });
+
+    // Print each plan as soon as everything before it is done
+    for (unsigned int i = 0; i < files.size(); i++) {
+        string result;
+        {
+            unique_lock<mutex> guard(resultLock);
+            resultReady.wait(guard, [&]() { return (bool)finished[i]; });
+            result.swap(results[i]);
+        }
+        cout << result;
+    }
+    pool.wait();
+    return 0;
+}
+
+int main (int argc, char** argv) {
+    string inputName = "";
+    string catalogName = "";
+    string socketPath = "";
+    string batchPath = "";
+    string snapshotName = "";
+    string preloadName = "";
+    string generateDir = "";
+    string calibrateDir = "";
+    string profileName = "";
+    string costProfileName = "";
+    bool serve = false;
+    int nthreads = thread::hardware_concurrency();
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--bushy") {
+            bushyJoins = true;
+        } else if (arg == "--serve" && i + 1 < argc) {
+            serve = true;
+            catalogName = argv[++i];
+        } else if (arg == "--socket" && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (arg == "--batch" && i + 2 < argc) {
+            catalogName = argv[++i];
+            batchPath = argv[++i];
+        } else if (arg == "--compile-catalog" && i + 2 < argc) {
+            catalogName = argv[++i];
+            snapshotName = argv[++i];
+        } else if (arg == "--catalog" && i + 1 < argc) {
+            preloadName = argv[++i];
+        } else if (arg == "--stats") {
+            statsTable = true;
+            collectStats = true;
+        } else if (arg == "--stats-json") {
+            statsJson = true;
+            collectStats = true;
+        } else if (arg == "--buffer-pages" && i + 1 < argc) {
+            bufferPages = max(stoi(argv[++i]), 3);
+        } else if (arg == "--plan-cache" && i + 1 < argc) {
+            planCache.capacity = stoi(argv[++i]);
+        } else if (arg == "--plan-cache-mb" && i + 1 < argc) {
+            planCache.maxBytes = (size_t)max(stoi(argv[++i]), 0) << 20;
+        } else if (arg == "--parse-threads" && i + 1 < argc) {
+            parseThreads = stoi(argv[++i]);
+        } else if (arg == "--generate-data" && i + 1 < argc) {
+            generateDir = argv[++i];
+        } else if (arg == "--execute" && i + 1 < argc) {
+            dataDir = argv[++i];
+        } else if (arg == "--result" && i + 1 < argc) {
+            resultFile = argv[++i];
+        } else if (arg == "--simd" && i + 1 < argc) {
+            string level = argv[++i];
+            for (int l = SIMD_SCALAR; l < simdLevel; l++) {
+                if (level == simdLevelNames[l]) {
+                    simdLevel = (SimdLevel)l;
+                }
+            }
+        } else if (arg == "--calibrate" && i + 2 < argc) {
+            calibrateDir = argv[++i];
+            profileName = argv[++i];
+        } else if (arg == "--cost-profile" && i + 1 < argc) {
+            costProfileName = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            nthreads = stoi(argv[++i]);
+        } else {
+            inputName = arg;
+        }
+    }
+
+    execThreads = max(nthreads, 1);
+
+    // Measures the cost model on this machine instead of optimizing
+    if (calibrateDir != "") {
+        if (preloadName != "" && !loadCatalog(preloadName)) {
+            return 1;
+        }
+        internDataColumns();
+        // The cost model describes one worker, so plans are timed on one
+        execThreads = 1;
+        return calibrate(calibrateDir, profileName) ? 0 : 1;
+    }
+    if (costProfileName != "" && !loadCostProfile(costProfileName)) {
+        return 1;
+    }
+
+    // Compiles a textual catalog into a binary snapshot for faster startup
+    if (snapshotName != "") {
+        if (!loadCatalog(catalogName) || !writeSnapshot(snapshotName)) {
+            return 1;
+        }
+        return 0;
+    }
+
+    // Batch mode shares one read-only catalog between all the worker threads
+    if (batchPath != "") {
+        if (!loadCatalog(catalogName)) {
+            return 1;
+        }
+        internDataColumns();
+        // Queries already run in parallel, so each one executes on a single thread
+        execThreads = 1;
+        int status = runBatch(batchPath, max(nthreads, 1));
+        printCacheStats();
+        printStats();
+        return status;
+    }
+
+    // Service mode keeps the catalog resident and optimizes queries as they arrive
+    if (serve) {
+        if (!loadCatalog(catalogName)) {
+            return 1;
+        }
+        internDataColumns();
+        if (socketPath != "") {
+            return serveSocket(socketPath);
+        }
+        serveStream(STDIN_FILENO, STDOUT_FILENO);
+        printCacheStats();
+        printStats();
+        return 0;
+    }
+
+    if (inputName == "") {
+        cerr << "Please pass 1 input file to the program" << endl;
+        return 1;
+    }
+    if (preloadName != "" && !loadStatements(preloadName, true)) {
+        return 1;
+    }
+    // Synthesizes data files for the tables of the catalog instead of optimizing
+    if (generateDir != "") {
+        if (!loadStatements(inputName, true)) {
+            return 1;
+        }
+        updateRegTbls();
+        return generateData(generateDir) ? 0 : 1;
+    }
+    if (!loadStatements(inputName, false)) {
+        return 1;
+    }
+    updateRegTbls();
+    internDataColumns();
+    optimizeQuery(cout);
+    printStats();
+}
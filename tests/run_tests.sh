@@ -0,0 +1,94 @@
+#!/bin/bash
+# Builds the optimizer and runs the regression cases in this directory
+# usage: tests/run_tests.sh
+cd "$(dirname "$0")"
+build=$(mktemp -d)
+trap 'rm -rf "$build"' EXIT
+g++ -O2 -std=c++17 -Wall ../QueryOptimizer.cpp -o "$build/QueryOptimizer" -pthread || exit 1
+qo="$build/QueryOptimizer"
+failed=0
+
+pass() {
+    echo "PASS $1"
+}
+
+fail() {
+    echo "FAIL $1: $2"
+    failed=1
+}
+
+# A served stream must print the same plans with the plan cache on and off
+check_plan_cache() {
+    local name=$1
+    "$qo" --serve "$name/catalog.txt" < "$name/stream.txt" > "$build/cached.txt" 2>/dev/null
+    "$qo" --serve "$name/catalog.txt" --plan-cache 0 < "$name/stream.txt" > "$build/uncached.txt" 2>/dev/null
+    if cmp -s "$build/cached.txt" "$build/uncached.txt"; then
+        pass "$name"
+    else
+        fail "$name" "plans differ with the plan cache enabled"
+    fi
+}
+
+# An input with bad statements must report exactly the expected errors and still exit normally
+check_errors() {
+    local name=$1
+    (cd "$name" && "$qo" input.txt > /dev/null 2> "$build/errors.txt")
+    local rc=$?
+    if [ $rc -ne 0 ]; then
+        fail "$name" "exited with status $rc"
+    elif ! cmp -s "$build/errors.txt" "$name/expected_errors.txt"; then
+        fail "$name" "unexpected errors"
+        diff "$name/expected_errors.txt" "$build/errors.txt"
+    else
+        pass "$name"
+    fi
+}
+
+# Points one string reference of a snapshot past its string table and recomputes the checksum
+# usage: corrupt_snapshot in out header-offset-of-section byte-in-first-record
+corrupt_snapshot() {
+    python3 - "$@" <<'PY'
+import struct, sys
+data = bytearray(open(sys.argv[1], "rb").read())
+section, = struct.unpack_from("<Q", data, int(sys.argv[3]))
+struct.pack_into("<I", data, section + int(sys.argv[4]), 0x7fffff00)
+header_size, = struct.unpack_from("<I", data, 12)
+checksum = 14695981039346656037
+for b in data[header_size:]:
+    checksum = ((checksum ^ b) * 1099511628211) & 0xffffffffffffffff
+struct.pack_into("<Q", data, 16, checksum)
+open(sys.argv[2], "wb").write(data)
+PY
+}
+
+# A compiled snapshot must plan like its text catalog, and a snapshot with a valid checksum whose string
+# references point past the string table must be rejected
+check_snapshot() {
+    local name=$1
+    "$qo" --compile-catalog "$name/catalog.txt" "$build/catalog.bin" > /dev/null || { fail "$name" "cannot compile the catalog"; return; }
+    "$qo" --catalog "$name/catalog.txt" "$name/query.txt" > "$build/text.txt" 2>&1
+    "$qo" --catalog "$build/catalog.bin" "$name/query.txt" > "$build/snapshot.txt" 2>&1
+    if ! cmp -s "$build/text.txt" "$build/snapshot.txt"; then
+        fail "$name" "plans differ between the text catalog and its snapshot"
+        return
+    fi
+    # Column names, foreign key column and referenced column, index names and RF columns
+    for field in 72:0 80:0 80:16 88:0 96:0; do
+        corrupt_snapshot "$build/catalog.bin" "$build/corrupt.bin" "${field%%:*}" "${field##*:}"
+        "$qo" --catalog "$build/corrupt.bin" "$name/query.txt" > /dev/null 2> "$build/errors.txt"
+        local rc=$?
+        if [ $rc -eq 0 ] || ! grep -q "corrupt table record" "$build/errors.txt"; then
+            fail "$name" "corrupt string at $field was not rejected (status $rc)"
+            return
+        fi
+    done
+    pass "$name"
+}
+
+check_plan_cache plan_cache_merge
+check_errors skipped_operation
+check_errors unknown_table
+check_errors out_of_range
+check_snapshot snapshot
+
+exit $failed